@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2015-2024 "IoT.bzh"
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Timing of the conversions of dbus-jsonc.c
+ *
+ * usage: bench-convert [ITERATIONS [COUNT [DEPTH]]]
+ *
+ * Each payload is converted ITERATIONS times. Building it against the
+ * dbus-jsonc.c of another revision compares the revisions. The results
+ * of the conversions are checked by the test test-convert.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <systemd/sd-bus.h>
+#include <json-c/json.h>
+
+#include "dbus-jsonc.h"
+#include "bench.h"
+
+static sd_bus *bus;
+static int iterations, count, depth;
+
+/* payload a{sv} of mixed properties */
+static sd_bus_message *make_properties(void)
+{
+	int i;
+	char name[32];
+	sd_bus_message *msg = bench_message(bus);
+
+	bench_check(sd_bus_message_open_container(msg, 'a', "{sv}"), "open");
+	for (i = 0 ; i < count ; i++) {
+		snprintf(name, sizeof name, "Property%d", i);
+		switch (i % 4) {
+		case 0: bench_check(sd_bus_message_append(msg, "{sv}", name, "s", name), "append"); break;
+		case 1: bench_check(sd_bus_message_append(msg, "{sv}", name, "u", (unsigned)i), "append"); break;
+		case 2: bench_check(sd_bus_message_append(msg, "{sv}", name, "b", i & 1), "append"); break;
+		default: bench_check(sd_bus_message_append(msg, "{sv}", name, "as", 2, "a", name), "append"); break;
+		}
+	}
+	bench_check(sd_bus_message_close_container(msg), "close");
+	return msg;
+}
+
+/* payload a(isd) of structures */
+static sd_bus_message *make_structs(void)
+{
+	int i;
+	sd_bus_message *msg = bench_message(bus);
+
+	bench_check(sd_bus_message_open_container(msg, 'a', "(isd)"), "open");
+	for (i = 0 ; i < count ; i++)
+		bench_check(sd_bus_message_append(msg, "(isd)", i, "item", i * 0.5), "append");
+	bench_check(sd_bus_message_close_container(msg), "close");
+	return msg;
+}
+
+/* payload of variants nested depth times */
+static sd_bus_message *make_nested(void)
+{
+	int i;
+	sd_bus_message *msg = bench_message(bus);
+
+	for (i = 0 ; i < depth ; i++)
+		bench_check(sd_bus_message_open_container(msg, 'v', "v"), "open");
+	bench_check(sd_bus_message_append(msg, "v", "i", 42), "append");
+	for (i = 0 ; i < depth ; i++)
+		bench_check(sd_bus_message_close_container(msg), "close");
+	return msg;
+}
+
+/* JSON of count string dictionnaries nested depth times */
+static struct json_object *make_json_nested(void)
+{
+	int i, j;
+	char name[32];
+	struct json_object *obj, *sub;
+
+	obj = json_object_new_int(42);
+	for (i = 0 ; i < depth ; i++) {
+		sub = json_object_new_object();
+		for (j = 1 ; j < count / depth ; j++) {
+			snprintf(name, sizeof name, "k%d", j);
+			json_object_object_add(sub, name, json_object_new_string(name));
+		}
+		json_object_object_add(sub, "next", obj);
+		obj = sub;
+	}
+	return obj;
+}
+
+/* JSON of an array of count arrays of integers */
+static struct json_object *make_json_arrays(void)
+{
+	int i, j;
+	struct json_object *obj, *sub;
+
+	obj = json_object_new_array();
+	for (i = 0 ; i < count ; i++) {
+		sub = json_object_new_array();
+		for (j = 0 ; j < 8 ; j++)
+			json_object_array_add(sub, json_object_new_int(i * j));
+		json_object_array_add(obj, sub);
+	}
+	sub = json_object_new_array();
+	json_object_array_add(sub, obj);
+	return sub;
+}
+
+/* JSON of arrays nested depth times */
+static struct json_object *make_json_nested_arrays(void)
+{
+	int i, j;
+	struct json_object *obj, *sub;
+
+	obj = json_object_new_int(42);
+	for (i = 0 ; i < depth ; i++) {
+		sub = json_object_new_array();
+		for (j = 1 ; j < count / depth ; j++)
+			json_object_array_add(sub, json_object_new_int(j));
+		json_object_array_add(sub, obj);
+		obj = sub;
+	}
+	sub = json_object_new_array();
+	json_object_array_add(sub, obj);
+	return sub;
+}
+
+/* time in ns of ITERATIONS conversions of the message */
+static double time_unpack(sd_bus_message *msg)
+{
+	int i;
+	uint64_t start;
+	struct json_object *obj;
+
+	start = bench_now();
+	for (i = 0 ; i < iterations ; i++) {
+		sd_bus_message_rewind(msg, 1);
+		if (msg2jsonc(msg, &obj) >= 0)
+			json_object_put(obj);
+	}
+	return (double)(bench_now() - start) / iterations;
+}
+
+/* times the unpacking of the message */
+static void unpack(const char *name, sd_bus_message *msg)
+{
+	int rc;
+	struct json_object *obj;
+
+	bench_seal(msg);
+	rc = msg2jsonc(msg, &obj);
+	if (rc >= 0)
+		json_object_put(obj);
+	printf("unpack %-12s %9.0f ns  %s\n", name, time_unpack(msg), rc < 0 ? "fails" : "ok");
+	sd_bus_message_unref(msg);
+}
+
+/* time in ns of ITERATIONS conversions of the json */
+static double time_pack(const char *signature, struct json_object *obj)
+{
+	int i;
+	uint64_t start;
+	sd_bus_message *msg;
+
+	start = bench_now();
+	for (i = 0 ; i < iterations ; i++) {
+		msg = bench_message(bus);
+		jsonc2msg(msg, signature, obj);
+		sd_bus_message_unref(msg);
+	}
+	return (double)(bench_now() - start) / iterations;
+}
+
+/* times the packing of the json */
+static void pack(const char *name, const char *signature, struct json_object *obj)
+{
+	int rc;
+	sd_bus_message *msg;
+
+	msg = bench_message(bus);
+	rc = jsonc2msg(msg, signature, obj);
+	sd_bus_message_unref(msg);
+	printf("pack   %-12s %9.0f ns  %s\n", name, time_pack(signature, obj), rc < 0 ? "fails" : "ok");
+	json_object_put(obj);
+}
+
+int main(int ac, char **av)
+{
+	iterations = ac > 1 ? atoi(av[1]) : 10000;
+	count = ac > 2 ? atoi(av[2]) : 100;
+	depth = ac > 3 ? atoi(av[3]) : 30;
+
+	bench_bus(&bus, NULL);
+
+	unpack("a{sv}", make_properties());
+	unpack("a(isd)", make_structs());
+	unpack("nested-v", make_nested());
+
+	pack("nested-a{sv}", "a{sv}", make_json_nested());
+	pack("aai", "aai", make_json_arrays());
+	pack("nested-av", "av", make_json_nested_arrays());
+	pack("a(isd)", "a(isd)", json_tokener_parse("[[[1,\"a\",0.5],[2,\"b\",1.5]]]"));
+
+	sd_bus_unref(bus);
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2015-2024 "IoT.bzh"
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Throughput of the conversion of messages carrying doubles to JSON text
+ *
+ * usage: bench-double [ITERATIONS [COUNT]]
+ *
+ * For each payload, a message of COUNT doubles is converted ITERATIONS
+ * times with msg2jsonc and serialized. The text of the first conversion
+ * is read back to check that every double is restored exactly.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <systemd/sd-bus.h>
+#include <json-c/json.h>
+
+#include "dbus-jsonc.h"
+#include "bench.h"
+
+/* the doubles put in messages */
+static double *values;
+
+/* random doubles of various magnitudes */
+static void make_values(int count)
+{
+	int i;
+
+	values = malloc((size_t)count * sizeof *values);
+	for (i = 0 ; i < count ; i++) {
+		switch (i & 3) {
+		case 0: values[i] = (double)(rand() % 1000); break;
+		case 1: values[i] = (double)rand() / RAND_MAX; break;
+		case 2: values[i] = (double)(rand() % 100000) / 100; break;
+		default: values[i] = ((double)rand() - RAND_MAX / 2) * 1e-7; break;
+		}
+	}
+}
+
+/* payload ad */
+static sd_bus_message *make_ad(sd_bus *bus, int count)
+{
+	sd_bus_message *msg = bench_message(bus);
+	bench_check(sd_bus_message_append_array(msg, 'd', values, (size_t)count * sizeof *values), "append");
+	return msg;
+}
+
+/* payload a{sd} */
+static sd_bus_message *make_asd(sd_bus *bus, int count)
+{
+	int i;
+	char name[32];
+	sd_bus_message *msg = bench_message(bus);
+
+	bench_check(sd_bus_message_open_container(msg, 'a', "{sd}"), "open");
+	for (i = 0 ; i < count ; i++) {
+		snprintf(name, sizeof name, "sensor-%d", i);
+		bench_check(sd_bus_message_append(msg, "{sd}", name, values[i]), "append");
+	}
+	bench_check(sd_bus_message_close_container(msg), "close");
+	return msg;
+}
+
+/* payload a{sv} of doubles, as for properties */
+static sd_bus_message *make_asv(sd_bus *bus, int count)
+{
+	int i;
+	char name[32];
+	sd_bus_message *msg = bench_message(bus);
+
+	bench_check(sd_bus_message_open_container(msg, 'a', "{sv}"), "open");
+	for (i = 0 ; i < count ; i++) {
+		snprintf(name, sizeof name, "Property%d", i);
+		bench_check(sd_bus_message_append(msg, "{sv}", name, "d", values[i]), "append");
+	}
+	bench_check(sd_bus_message_close_container(msg), "close");
+	return msg;
+}
+
+/* is the item the original value? variants are arrays of their value */
+static int same(struct json_object *item, double value)
+{
+	if (json_object_is_type(item, json_type_array) && json_object_array_length(item) == 1)
+		item = json_object_array_get_idx(item, 0);
+	return json_object_is_type(item, json_type_double)
+		&& json_object_get_double(item) == value;
+}
+
+/* count the doubles of the JSON text not equal to the original values */
+static int check(const char *text, int count)
+{
+	int i, bad = 0;
+	struct json_object *obj, *arr, *item;
+	struct json_object_iterator it, end;
+
+	obj = json_tokener_parse(text);
+	arr = json_object_array_get_idx(obj, 0);
+	if (json_object_is_type(arr, json_type_array)) {
+		for (i = 0 ; i < count ; i++) {
+			item = json_object_array_get_idx(arr, (size_t)i);
+			bad += !same(item, values[i]);
+		}
+	}
+	else {
+		i = 0;
+		it = json_object_iter_begin(arr);
+		end = json_object_iter_end(arr);
+		for ( ; !json_object_iter_equal(&it, &end) ; json_object_iter_next(&it), i++) {
+			item = json_object_iter_peek_value(&it);
+			bad += !same(item, values[i]);
+		}
+		bad += count - i;
+	}
+	json_object_put(obj);
+	return bad;
+}
+
+/* run the benchmark of one payload */
+static void run(const char *name, sd_bus_message *msg, int iterations, int count)
+{
+	int i, bad = 0;
+	size_t bytes = 0;
+	uint64_t start, duration;
+	const char *text;
+	struct json_object *obj;
+
+	bench_seal(msg);
+	start = bench_now();
+	for (i = 0 ; i < iterations ; i++) {
+		bench_check(sd_bus_message_rewind(msg, 1), "rewind");
+		bench_check(msg2jsonc(msg, &obj), "msg2jsonc");
+		text = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN);
+		bytes += strlen(text);
+		if (i == 0)
+			bad = check(text, count);
+		json_object_put(obj);
+	}
+	duration = bench_now() - start;
+
+	printf("%-6s %8.0f msg/s %10.0f doubles/s %8.2f MB/s %7.0f ns/double  mismatches %d\n",
+		name,
+		iterations * 1e9 / (double)duration,
+		(double)iterations * count * 1e9 / (double)duration,
+		bytes * 1e3 / (double)duration,
+		(double)duration / ((double)iterations * count),
+		bad);
+	sd_bus_message_unref(msg);
+}
+
+int main(int ac, char **av)
+{
+	sd_bus *bus;
+	int iterations = ac > 1 ? atoi(av[1]) : 10000;
+	int count = ac > 2 ? atoi(av[2]) : 100;
+
+	bench_bus(&bus, NULL);
+	make_values(count);
+
+	run("ad", make_ad(bus, count), iterations, count);
+	run("a{sd}", make_asd(bus, count), iterations, count);
+	run("a{sv}", make_asv(bus, count), iterations, count);
+
+	sd_bus_unref(bus);
+	free(values);
+	return 0;
+}
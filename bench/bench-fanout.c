@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2015-2024 "IoT.bzh"
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Fanout of signals to N events having M listeners each
+ *
+ * usage: bench-fanout [SIGNALS [MAXEVENTS [MAXLISTENERS]]]
+ *
+ * As on_signal of dbus-binding.c, the envelope of a PropertiesChanged
+ * signal is built once and wrapped in a counted data, then pushed to the
+ * N events linked to its match.
+ *
+ * The binder is not available here: its push of events is modeled by a
+ * minimal stub doing what afb does for each listener:
+ *  - the push references the data once per listener and queues a
+ *    delivery job for the session of the listener;
+ *  - the jobs then run: in-process listeners receive the JSON object
+ *    of the data, websocket listeners serialize it to text in a frame
+ *    of their own and write it to a socket.
+ * json-c serializes the whole object at each call, so each websocket
+ * listener pays for a complete serialization.
+ *
+ * Are reported the throughput of signals, the cost of building the
+ * envelope, the cost of the push (queueing) and of the delivery per
+ * listener, and the latency from the reception of the signal to its
+ * last delivery. The locking and the scheduling of the threads of the
+ * binder and its websocket protocol are not measured.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <systemd/sd-bus.h>
+#include <json-c/json.h>
+
+#include "dbus-jsonc.h"
+#include "bench.h"
+
+/* kinds of listeners */
+enum kind { In_Process, Websocket };
+
+/* size of the header of websocket frames */
+#define FRAME_HEADER 10
+
+/* counted data, as the afb data of type JSON_C made by on_signal */
+struct data
+{
+	/** reference count */
+	unsigned refcount;
+	/** the JSON object */
+	struct json_object *obj;
+};
+
+/* delivery job queued for a listener */
+struct job
+{
+	/** link to next */
+	struct job *next;
+	/** the delivered data */
+	struct data *data;
+};
+
+/* listener of an event and its queue of jobs */
+struct listener
+{
+	/** kind of the listener */
+	enum kind kind;
+	/** queue of the jobs */
+	struct job *head;
+	struct job **ptail;
+};
+
+/* event and its listeners */
+struct event
+{
+	/** count of listeners */
+	int nlisteners;
+	/** the listeners */
+	struct listener *listeners;
+};
+
+/* socket of websocket listeners */
+static int wsfds[2];
+
+/* count of bytes received on the websocket side */
+static volatile size_t received;
+
+/* drains the websocket side */
+static void *drain(void *arg)
+{
+	char buffer[65536];
+	ssize_t len;
+
+	while ((len = read(wsfds[1], buffer, sizeof buffer)) > 0)
+		received += (size_t)len;
+	return NULL;
+}
+
+/* a PropertiesChanged signal */
+static sd_bus_message *make_signal(sd_bus *bus)
+{
+	int i;
+	char name[32];
+	sd_bus_message *msg;
+
+	bench_check(sd_bus_message_new_signal(bus, &msg, "/org/bench/Sensor",
+			"org.freedesktop.DBus.Properties", "PropertiesChanged"), "new_signal");
+	bench_check(sd_bus_message_append(msg, "s", "org.bench.Sensor"), "append");
+	bench_check(sd_bus_message_open_container(msg, 'a', "{sv}"), "open");
+	for (i = 0 ; i < 10 ; i++) {
+		snprintf(name, sizeof name, "Value%d", i);
+		bench_check(sd_bus_message_append(msg, "{sv}", name, "d", 20.5 + i), "append");
+	}
+	bench_check(sd_bus_message_close_container(msg), "close");
+	bench_check(sd_bus_message_append(msg, "as", 0), "append");
+	bench_check(sd_bus_message_set_sender(msg, ":1.42"), "set_sender");
+	bench_seal(msg);
+	return msg;
+}
+
+/* the envelope built by make_signal_data, wrapped in a data */
+static struct data *make_data(sd_bus_message *msg)
+{
+	struct json_object *obj, *jdata = NULL;
+	struct data *data;
+	int rc;
+
+	sd_bus_message_rewind(msg, 1);
+	rc = msg2jsonc(msg, &jdata);
+	obj = json_object_new_object();
+	json_object_object_add(obj, "bus", json_object_new_string("system"));
+	json_object_object_add(obj, "status", json_object_new_string(rc >= 0 ? "success" : "error"));
+	json_object_object_add(obj, "data", jdata);
+	json_object_object_add(obj, "sender",    json_object_new_string(sd_bus_message_get_sender(msg)));
+	json_object_object_add(obj, "path",      json_object_new_string(sd_bus_message_get_path(msg)));
+	json_object_object_add(obj, "interface", json_object_new_string(sd_bus_message_get_interface(msg)));
+	json_object_object_add(obj, "member",    json_object_new_string(sd_bus_message_get_member(msg)));
+	data = malloc(sizeof *data);
+	data->refcount = 1;
+	data->obj = obj;
+	return data;
+}
+
+/* drop a reference to the data */
+static void data_unref(struct data *data)
+{
+	if (--data->refcount == 0) {
+		json_object_put(data->obj);
+		free(data);
+	}
+}
+
+/* push the data to the event: one reference and one job per listener */
+static void event_push(struct event *evt, struct data *data)
+{
+	struct listener *listener;
+	struct job *job;
+	int l;
+
+	for (l = 0 ; l < evt->nlisteners ; l++) {
+		listener = &evt->listeners[l];
+		job = malloc(sizeof *job);
+		job->next = NULL;
+		job->data = data;
+		data->refcount++;
+		*listener->ptail = job;
+		listener->ptail = &job->next;
+	}
+}
+
+/* an in-process listener reads a value */
+static size_t in_process(struct json_object *obj)
+{
+	struct json_object *member;
+
+	json_object_object_get_ex(obj, "member", &member);
+	return (size_t)json_object_get_string_len(member);
+}
+
+/* a websocket listener serializes in its own frame and sends */
+static size_t websocket(struct json_object *obj)
+{
+	size_t len;
+	ssize_t sent;
+	const char *text = json_object_to_json_string_length(obj, JSON_C_TO_STRING_PLAIN, &len);
+	char *frame = malloc(FRAME_HEADER + len);
+
+	memset(frame, 0, FRAME_HEADER);
+	memcpy(&frame[FRAME_HEADER], text, len);
+	sent = write(wsfds[0], frame, FRAME_HEADER + len);
+	free(frame);
+	return sent < 0 ? 0 : (size_t)sent;
+}
+
+/* run the jobs of the listener */
+static size_t deliver(struct listener *listener)
+{
+	struct job *job;
+	size_t sink = 0;
+
+	while ((job = listener->head) != NULL) {
+		listener->head = job->next;
+		sink += listener->kind == In_Process ? in_process(job->data->obj) : websocket(job->data->obj);
+		data_unref(job->data);
+		free(job);
+	}
+	listener->ptail = &listener->head;
+	return sink;
+}
+
+static void run(sd_bus_message *msg, enum kind kind, int nevts, int nlist, int nsig)
+{
+	int s, e, l;
+	size_t sink = 0;
+	uint64_t t0, t1, t2, t3, build = 0, push = 0, delivery = 0, *samples;
+	struct event *evts;
+	struct data *data;
+
+	evts = calloc((size_t)nevts, sizeof *evts);
+	for (e = 0 ; e < nevts ; e++) {
+		evts[e].nlisteners = nlist;
+		evts[e].listeners = calloc((size_t)nlist, sizeof *evts[e].listeners);
+		for (l = 0 ; l < nlist ; l++) {
+			evts[e].listeners[l].kind = kind;
+			evts[e].listeners[l].ptail = &evts[e].listeners[l].head;
+		}
+	}
+	samples = malloc((size_t)nsig * sizeof *samples);
+	for (s = 0 ; s < nsig ; s++) {
+		t0 = bench_now();
+		data = make_data(msg);
+		t1 = bench_now();
+		for (e = 0 ; e < nevts ; e++)
+			event_push(&evts[e], data);
+		data_unref(data);
+		t2 = bench_now();
+		for (e = 0 ; e < nevts ; e++)
+			for (l = 0 ; l < nlist ; l++)
+				sink += deliver(&evts[e].listeners[l]);
+		t3 = bench_now();
+		build += t1 - t0;
+		push += t2 - t1;
+		delivery += t3 - t2;
+		samples[s] = t3 - t0;
+	}
+	printf("%-10s events %3d listeners %3d %9.0f signals/s  build %6.0f ns  push %5.0f ns  delivery %6.0f ns"
+		"  latency p50 %8llu ns  p99 %8llu ns\n",
+		kind == In_Process ? "in-process" : "websocket", nevts, nlist,
+		(double)nsig * 1e9 / (double)(build + push + delivery),
+		(double)build / nsig,
+		(double)push / ((double)nsig * nevts * nlist),
+		(double)delivery / ((double)nsig * nevts * nlist),
+		(unsigned long long)bench_percentile(samples, (size_t)nsig, 50),
+		(unsigned long long)bench_percentile(samples, (size_t)nsig, 99));
+	free(samples);
+	for (e = 0 ; e < nevts ; e++)
+		free(evts[e].listeners);
+	free(evts);
+	if (sink == 0)
+		printf("nothing delivered\n");
+}
+
+int main(int ac, char **av)
+{
+	sd_bus *bus;
+	sd_bus_message *msg;
+	pthread_t tid;
+	int nevts, nlist;
+	int nsig = ac > 1 ? atoi(av[1]) : 10000;
+	int maxevts = ac > 2 ? atoi(av[2]) : 16;
+	int maxlist = ac > 3 ? atoi(av[3]) : 64;
+
+	bench_check(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, wsfds) ? -1 : 0, "socketpair");
+	pthread_create(&tid, NULL, drain, NULL);
+
+	bench_bus(&bus, NULL);
+	msg = make_signal(bus);
+
+	for (nevts = 1 ; nevts <= maxevts ; nevts *= 4)
+		for (nlist = 1 ; nlist <= maxlist ; nlist *= 8) {
+			run(msg, In_Process, nevts, nlist, nsig);
+			run(msg, Websocket, nevts, nlist, nsig);
+		}
+
+	sd_bus_message_unref(msg);
+	sd_bus_unref(bus);
+	return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2015-2024 "IoT.bzh"
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Contention of the job queue of the DBUS thread
+ *
+ * usage: bench-queue [JOBS [QUEUE [WORK]]]
+ *
+ * The queue is the one of dbus-queue.c used by dbus-binding.c:
+ * a mutex protected array of QUEUE jobs (10 by default as MXNRJOB)
+ * shifted at each insertion and an eventfd waking the consumer.
+ * The consumer thread, as gotjob of dbus-binding.c, runs the jobs
+ * spinning WORK nanoseconds (default 0).
+ *
+ * For 1 up to 64 producer threads, each producer submits JOBS jobs
+ * (default 100000) as fast as possible. Are reported the throughput of
+ * accepted jobs, the rate of jobs rejected because the queue is full,
+ * the count of wakeups of the consumer and the latency of submission.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "dbus-queue.h"
+#include "bench.h"
+
+/*****************************************************************************************/
+/* the job queue of dbus-queue.c */
+/*****************************************************************************************/
+
+struct job
+{
+	void (*proc)(void*);
+	void *closure;
+};
+
+static struct dbus_queue queue;
+
+/* counts of wakeups and of processed jobs */
+static uint64_t wakeups, processed;
+
+static void gotjob(void)
+{
+	struct job job;
+
+	dbus_queue_wait(&queue);
+	wakeups++;
+	while (dbus_queue_get(&queue, &job))
+		job.proc(job.closure);
+}
+
+/*****************************************************************************************/
+/* measures */
+/*****************************************************************************************/
+
+static int jobcount, work;
+static volatile int stopping;
+
+/* the stub processor */
+static void proc(void *closure)
+{
+	uint64_t end = work ? bench_now() + (uint64_t)work : 0;
+	while (work && bench_now() < end);
+	__atomic_store_n(&processed, processed + 1, __ATOMIC_RELEASE);
+}
+
+/* the consumer, as the DBUS thread */
+static void *consumer(void *arg)
+{
+	while (!stopping)
+		gotjob();
+	return NULL;
+}
+
+/* a producer */
+struct producer
+{
+	pthread_t tid;
+	uint64_t *samples;
+	int rejected;
+};
+
+static void *produce(void *arg)
+{
+	struct producer *prod = arg;
+	struct job job = { .proc = proc, .closure = prod };
+	uint64_t start;
+	int i;
+
+	for (i = 0 ; i < jobcount ; i++) {
+		start = bench_now();
+		if (dbus_queue_put(&queue, &job) < 0)
+			prod->rejected++;
+		else
+			dbus_queue_wake(&queue);
+		prod->samples[i] = bench_now() - start;
+	}
+	return NULL;
+}
+
+static void run(int nthr)
+{
+	struct producer *prods;
+	uint64_t *samples, start, duration;
+	pthread_t tid;
+	int i, rejected = 0;
+	size_t n = (size_t)nthr * (size_t)jobcount;
+
+	wakeups = processed = 0;
+	stopping = 0;
+	pthread_create(&tid, NULL, consumer, NULL);
+
+	samples = malloc(n * sizeof *samples);
+	prods = calloc((size_t)nthr, sizeof *prods);
+	start = bench_now();
+	for (i = 0 ; i < nthr ; i++) {
+		prods[i].samples = &samples[(size_t)i * (size_t)jobcount];
+		pthread_create(&prods[i].tid, NULL, produce, &prods[i]);
+	}
+	for (i = 0 ; i < nthr ; i++) {
+		pthread_join(prods[i].tid, NULL);
+		rejected += prods[i].rejected;
+	}
+
+	/* wait the end of the processing */
+	while (__atomic_load_n(&processed, __ATOMIC_ACQUIRE) + (uint64_t)rejected < n)
+		sched_yield();
+	duration = bench_now() - start;
+	stopping = 1;
+	dbus_queue_wake(&queue);
+	pthread_join(tid, NULL);
+
+	printf("%3d threads %10.0f jobs/s  rejected %5.1f%%  wakeups %8llu (%5.1f jobs/wakeup)"
+		"  submit p50 %6llu ns  p99 %7llu ns  p99.9 %8llu ns\n",
+		nthr,
+		(double)processed * 1e9 / (double)duration,
+		100.0 * rejected / (double)n,
+		(unsigned long long)wakeups, (double)processed / (double)(wakeups ?: 1),
+		(unsigned long long)bench_percentile(samples, n, 50),
+		(unsigned long long)bench_percentile(samples, n, 99),
+		(unsigned long long)bench_percentile(samples, n, 99.9));
+
+	free(samples);
+	free(prods);
+}
+
+int main(int ac, char **av)
+{
+	int nthr;
+	int mxnrjob;
+
+	jobcount = ac > 1 ? atoi(av[1]) : 100000;
+	mxnrjob = ac > 2 ? atoi(av[2]) : 10;
+	work = ac > 3 ? atoi(av[3]) : 0;
+
+	bench_check(dbus_queue_init(&queue, mxnrjob, sizeof(struct job)), "dbus_queue_init");
+	for (nthr = 1 ; nthr <= 64 ; nthr *= 2)
+		run(nthr);
+	return 0;
+}
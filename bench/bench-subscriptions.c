@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2015-2024 "IoT.bzh"
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Scaling of the subscriptions with the count of matches and events
+ *
+ * usage: bench-subscriptions [MAXCOUNT [OPERATIONS]]
+ *
+ * The lists of matches (watch), of events (evrec) and of their links
+ * (evlist) are the ones of dbus-subs.c, used by dbus-binding.c, with
+ * afb events replaced by counters.
+ *
+ * For COUNT = 10, 100, ... up to MAXCOUNT, COUNT matches and COUNT
+ * events are subscribed on a private bus, each match being linked to
+ * 2 events. Then are measured OPERATIONS times:
+ *  - the search of a subscription (subscribing again an existing one)
+ *  - unsubscribing and subscribing again (churn)
+ *  - the latency from the emission of a signal to the push of
+ *    its events
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <systemd/sd-bus.h>
+
+#include "dbus-subs.h"
+#include "bench.h"
+
+/*****************************************************************************************/
+/* the subscriptions of dbus-subs.c */
+/*****************************************************************************************/
+
+/* event, standing for afb events */
+struct evrec
+{
+	struct dbus_subs_evrec subs;
+	unsigned pushed;
+	char name[];
+};
+
+struct watch
+{
+	struct dbus_subs_watch subs;
+	sd_bus_slot *slot;
+};
+
+static struct dbus_subs subscriptions;
+static sd_bus *client, *server;
+
+/* count of pushed events and time of the last push */
+static unsigned pushed;
+static uint64_t pushtime;
+
+static int on_signal(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+{
+	struct watch *watch = userdata;
+	struct dbus_subs_evlist *evlist;
+
+	for (evlist = watch->subs.evlist ; evlist != NULL ; evlist = evlist->next) {
+		((struct evrec*)evlist->evrec)->pushed++;
+		pushed++;
+	}
+	pushtime = bench_now();
+	return 0;
+}
+
+static struct dbus_subs_evrec *create_evrec(void *closure, const char *name)
+{
+	struct evrec *evrec = malloc(sizeof *evrec + 1 + strlen(name));
+	if (evrec == NULL)
+		return NULL;
+	evrec->subs.name = strcpy(evrec->name, name);
+	evrec->pushed = 0;
+	return &evrec->subs;
+}
+
+static void release_evrec(void *closure, struct dbus_subs_evrec *evrec)
+{
+	free(evrec);
+}
+
+static struct dbus_subs_watch *create_watch(void *closure, const struct dbus_subs_spec *spec)
+{
+	struct watch *watch;
+	char *p;
+
+	watch = malloc(sizeof *watch + 3 + strlen(spec->busname) + strlen(spec->match) + strlen(spec->select));
+	if (watch == NULL)
+		return NULL;
+	p = (char*)&watch[1];
+	watch->subs.busname = p;
+	p = 1 + stpcpy(p, spec->busname);
+	watch->subs.match = p;
+	p = 1 + stpcpy(p, spec->match);
+	watch->subs.select = p;
+	stpcpy(p, spec->select);
+	watch->slot = NULL;
+	return &watch->subs;
+}
+
+static int start_watch(void *closure, struct dbus_subs_watch *subs)
+{
+	struct watch *watch = (struct watch*)subs;
+
+	if (watch->slot != NULL)
+		return 0;
+	return sd_bus_add_match_async(client, &watch->slot, subs->match, on_signal, NULL, watch);
+}
+
+static void release_watch(void *closure, struct dbus_subs_watch *subs)
+{
+	struct watch *watch = (struct watch*)subs;
+
+	sd_bus_slot_unref(watch->slot);
+	free(watch);
+}
+
+static const struct dbus_subs_itf itf = {
+	.create_evrec = create_evrec,
+	.release_evrec = release_evrec,
+	.create_watch = create_watch,
+	.start_watch = start_watch,
+	.release_watch = release_watch
+};
+
+static struct dbus_subs_evrec *add_sub(struct dbus_subs_spec *spec)
+{
+	return dbus_subs_add(&subscriptions, spec);
+}
+
+static int del_sub(struct dbus_subs_spec *spec)
+{
+	struct dbus_subs_watch *watch = dbus_subs_search_watch(&subscriptions, spec);
+	struct dbus_subs_evrec *evrec = dbus_subs_search_evrec(&subscriptions, spec->event);
+	struct dbus_subs_evlist *evlist = watch != NULL && evrec != NULL ? dbus_subs_search_evlist(watch, evrec) : NULL;
+	if (evlist == NULL)
+		return -1;
+	dbus_subs_remove(&subscriptions, watch, evlist);
+	return 0;
+}
+
+/*****************************************************************************************/
+/* measures */
+/*****************************************************************************************/
+
+/* the subscription of index i to its event j (0 or 1) */
+static struct dbus_subs_spec *spec(int i, int j, int count)
+{
+	static char match[128], event[32];
+	static struct dbus_subs_spec evs = { .busname = "system", .match = match, .select = "", .event = event };
+
+	snprintf(match, sizeof match, "type='signal',interface='org.bench',member='Signal%d'", i);
+	snprintf(event, sizeof event, "event-%d", (i + j * (count / 2 + 1)) % count);
+	return &evs;
+}
+
+/* prints the statistics of the samples */
+static void report(int count, const char *what, uint64_t *samples, int n)
+{
+	uint64_t sum = 0, p50, p99;
+	int i;
+
+	for (i = 0 ; i < n ; i++)
+		sum += samples[i];
+	p50 = bench_percentile(samples, (size_t)n, 50);
+	p99 = bench_percentile(samples, (size_t)n, 99);
+	printf("%6d %-12s avg %8.0f ns  p50 %8llu ns  p99 %8llu ns  max %8llu ns\n",
+		count, what, (double)sum / n, (unsigned long long)p50,
+		(unsigned long long)p99, (unsigned long long)samples[n - 1]);
+}
+
+/* emit the signal of index i and wait its dispatch */
+static uint64_t signal_latency(int i)
+{
+	char member[32];
+	unsigned before = pushed;
+	uint64_t start;
+
+	snprintf(member, sizeof member, "Signal%d", i);
+	start = bench_now();
+	bench_check(sd_bus_emit_signal(server, "/bench", "org.bench", member, "i", i), "emit");
+	bench_check(sd_bus_flush(server), "flush");
+	while (pushed == before)
+		if (sd_bus_process(client, NULL) == 0)
+			sd_bus_wait(client, 1000);
+	return pushtime - start;
+}
+
+static void run(int count, int operations)
+{
+	int i, j, k;
+	uint64_t start, *samples;
+
+	samples = malloc((size_t)operations * sizeof *samples);
+
+	/* subscribe */
+	start = bench_now();
+	for (i = 0 ; i < count ; i++)
+		for (j = 0 ; j < 2 ; j++)
+			if (add_sub(spec(i, j, count)) == NULL)
+				bench_check(-1, "add_sub");
+	printf("%6d %-12s avg %8.0f ns\n", count, "subscribe",
+		(double)(bench_now() - start) / (2 * count));
+
+	/* search */
+	for (k = 0 ; k < operations ; k++) {
+		i = rand() % count;
+		start = bench_now();
+		add_sub(spec(i, 0, count));
+		samples[k] = bench_now() - start;
+		del_sub(spec(i, 0, count));
+	}
+	report(count, "search", samples, operations);
+
+	/* churn */
+	for (k = 0 ; k < operations ; k++) {
+		i = rand() % count;
+		start = bench_now();
+		del_sub(spec(i, 1, count));
+		add_sub(spec(i, 1, count));
+		samples[k] = bench_now() - start;
+	}
+	report(count, "churn", samples, operations);
+
+	/* signals */
+	for (k = 0 ; k < operations ; k++)
+		samples[k] = signal_latency(rand() % count);
+	report(count, "signal", samples, operations);
+
+	/* unsubscribe */
+	start = bench_now();
+	for (i = 0 ; i < count ; i++)
+		for (j = 0 ; j < 2 ; j++)
+			del_sub(spec(i, j, count));
+	printf("%6d %-12s avg %8.0f ns\n", count, "unsubscribe",
+		(double)(bench_now() - start) / (2 * count));
+
+	free(samples);
+}
+
+int main(int ac, char **av)
+{
+	int count;
+	int maxcount = ac > 1 ? atoi(av[1]) : 10000;
+	int operations = ac > 2 ? atoi(av[2]) : 1000;
+
+	bench_bus(&client, &server);
+	dbus_subs_init(&subscriptions, &itf, NULL, NULL);
+	for (count = 10 ; count <= maxcount ; count *= 10)
+		run(count, operations);
+
+	sd_bus_unref(client);
+	sd_bus_unref(server);
+	return 0;
+}
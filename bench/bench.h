@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2015-2024 "IoT.bzh"
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * common helpers of the benchmark programs
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-id128.h>
+
+/* monotonic time in nanoseconds */
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* sort helper for bench_percentile */
+static inline int bench_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+/* sorts the samples and returns the percentile p (0..100) */
+static inline uint64_t bench_percentile(uint64_t *samples, size_t count, double p)
+{
+	size_t idx;
+
+	if (count == 0)
+		return 0;
+	qsort(samples, count, sizeof *samples, bench_cmp);
+	idx = (size_t)(p * (double)(count - 1) / 100 + 0.5);
+	return samples[idx];
+}
+
+/* stops the program on error */
+static inline void bench_check(int rc, const char *what)
+{
+	if (rc < 0) {
+		fprintf(stderr, "%s failed: %d\n", what, rc);
+		exit(1);
+	}
+}
+
+/*
+ * get the two ends of a private bus connection on a socket pair,
+ * no bus daemon is needed. The server end can be NULL.
+ */
+static inline void bench_bus(sd_bus **client, sd_bus **server)
+{
+	int fds[2];
+	sd_id128_t id;
+	sd_bus *bus;
+
+	bench_check(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) ? -1 : 0, "socketpair");
+
+	bench_check(sd_bus_new(&bus), "sd_bus_new");
+	bench_check(sd_bus_set_fd(bus, fds[0], fds[0]), "sd_bus_set_fd");
+	bench_check(sd_bus_start(bus), "sd_bus_start");
+	*client = bus;
+
+	if (server == NULL)
+		return;
+	bench_check(sd_id128_randomize(&id), "sd_id128_randomize");
+	bench_check(sd_bus_new(&bus), "sd_bus_new");
+	bench_check(sd_bus_set_fd(bus, fds[1], fds[1]), "sd_bus_set_fd");
+	bench_check(sd_bus_set_server(bus, 1, id), "sd_bus_set_server");
+	bench_check(sd_bus_set_anonymous(bus, 1), "sd_bus_set_anonymous");
+	bench_check(sd_bus_start(bus), "sd_bus_start");
+	*server = bus;
+}
+
+/* creates a method call message to be filled */
+static inline sd_bus_message *bench_message(sd_bus *bus)
+{
+	sd_bus_message *msg;
+	bench_check(sd_bus_message_new_method_call(bus, &msg, NULL,
+			"/bench", "org.bench", "Bench"), "sd_bus_message_new_method_call");
+	return msg;
+}
+
+/* seals the message and rewinds it for reading */
+static inline void bench_seal(sd_bus_message *msg)
+{
+	static uint64_t cookie = 0;
+	bench_check(sd_bus_message_seal(msg, ++cookie, 0), "sd_bus_message_seal");
+	bench_check(sd_bus_message_rewind(msg, 1), "sd_bus_message_rewind");
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Library interposing the allocator for accounting allocations per
+ * code path. It is preloaded in the binder: LD_PRELOAD=alloc-acct.so
+ * The sizes are the usable sizes given by the allocator.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <malloc.h>
+
+#include "alloc-acct.h"
+
+/* the allocator of the C library */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+
+/* the counters */
+static struct alloc_acct_counts counters[Acct_Path_Count];
+
+/* code path of the thread */
+static __thread int current;
+
+static void count_alloc(void *ptr)
+{
+	if (ptr != NULL) {
+		__atomic_add_fetch(&counters[current].mallocs, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&counters[current].allocated, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	}
+}
+
+static void count_free(void *ptr)
+{
+	if (ptr != NULL) {
+		__atomic_add_fetch(&counters[current].frees, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&counters[current].freed, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	}
+}
+
+void *malloc(size_t size)
+{
+	void *ptr = __libc_malloc(size);
+	count_alloc(ptr);
+	return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	void *ptr = __libc_calloc(nmemb, size);
+	count_alloc(ptr);
+	return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	void *result;
+
+	count_free(ptr);
+	result = __libc_realloc(ptr, size);
+	if (result == NULL && size != 0 && ptr != NULL)
+		/* not freed */
+		count_alloc(ptr);
+	else
+		count_alloc(result);
+	return result;
+}
+
+void free(void *ptr)
+{
+	count_free(ptr);
+	__libc_free(ptr);
+}
+
+/*
+ * The aligned allocations are released by free: they are counted too
+ * or the freed counters would exceed the allocated ones.
+ */
+
+void *memalign(size_t alignment, size_t size)
+{
+	void *ptr = __libc_memalign(alignment, size);
+	count_alloc(ptr);
+	return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0)
+		return EINVAL;
+	ptr = memalign(alignment, size);
+	if (ptr == NULL)
+		return ENOMEM;
+	*memptr = ptr;
+	return 0;
+}
+
+void *valloc(size_t size)
+{
+	void *ptr = __libc_valloc(size);
+	count_alloc(ptr);
+	return ptr;
+}
+
+void *pvalloc(size_t size)
+{
+	void *ptr = __libc_pvalloc(size);
+	count_alloc(ptr);
+	return ptr;
+}
+
+int alloc_acct_enter(int path)
+{
+	int previous = current;
+	if (path >= 0 && path < Acct_Path_Count)
+		current = path;
+	return previous;
+}
+
+void alloc_acct_leave(int previous)
+{
+	current = previous;
+}
+
+int alloc_acct_snapshot(int path, struct alloc_acct_counts *counts)
+{
+	if (path < 0 || path >= Acct_Path_Count)
+		return -1;
+	counts->mallocs = __atomic_load_n(&counters[path].mallocs, __ATOMIC_RELAXED);
+	counts->frees = __atomic_load_n(&counters[path].frees, __ATOMIC_RELAXED);
+	counts->allocated = __atomic_load_n(&counters[path].allocated, __ATOMIC_RELAXED);
+	counts->freed = __atomic_load_n(&counters[path].freed, __ATOMIC_RELAXED);
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * Accounting of allocations per code path
+ *
+ * When built with ALLOC_ACCOUNTING, the library alloc-acct.so interposes
+ * malloc, calloc, realloc, free and the aligned allocations when
+ * preloaded (LD_PRELOAD) in the binder. It counts the calls and bytes in the code path of the calling
+ * thread, set by acct_enter and restored by acct_leave.
+ * Without the preloaded library, or without ALLOC_ACCOUNTING, these
+ * functions do nothing.
+ */
+
+#include <stdint.h>
+
+/* code paths */
+enum alloc_acct_path {
+	Acct_Other,
+	Acct_Call,
+	Acct_Signal,
+	Acct_Subscribe,
+	Acct_Unsubscribe,
+	Acct_Msg2json,
+	Acct_Json2msg,
+	Acct_Envelope,
+	Acct_Watch,
+	Acct_Path_Count
+};
+
+/* names of the code paths */
+#define ALLOC_ACCT_PATH_NAMES \
+	"other", "call", "signal", "subscribe", "unsubscribe", \
+	"msg2json", "json2msg", "envelope", "watch"
+
+/* counters of a code path */
+struct alloc_acct_counts {
+	uint64_t mallocs;
+	uint64_t frees;
+	uint64_t allocated;
+	uint64_t freed;
+};
+
+/* names of the functions of alloc-acct.so */
+#define ALLOC_ACCT_ENTER    "alloc_acct_enter"
+#define ALLOC_ACCT_LEAVE    "alloc_acct_leave"
+#define ALLOC_ACCT_SNAPSHOT "alloc_acct_snapshot"
+
+#if ALLOC_ACCOUNTING
+
+#include <dlfcn.h>
+
+/* functions of the preloaded library, NULL when not preloaded */
+static struct {
+	int resolved;
+	int (*enter)(int path);
+	void (*leave)(int previous);
+	int (*snapshot)(int path, struct alloc_acct_counts *counts);
+} alloc_acct;
+
+static inline void acct_resolve(void)
+{
+	if (!__atomic_load_n(&alloc_acct.resolved, __ATOMIC_ACQUIRE)) {
+		alloc_acct.enter = (int(*)(int))dlsym(RTLD_DEFAULT, ALLOC_ACCT_ENTER);
+		alloc_acct.leave = (void(*)(int))dlsym(RTLD_DEFAULT, ALLOC_ACCT_LEAVE);
+		alloc_acct.snapshot = (int(*)(int,struct alloc_acct_counts*))dlsym(RTLD_DEFAULT, ALLOC_ACCT_SNAPSHOT);
+		__atomic_store_n(&alloc_acct.resolved, 1, __ATOMIC_RELEASE);
+	}
+}
+
+/* set the code path of the thread, returns the previous one */
+static inline int acct_enter(enum alloc_acct_path path)
+{
+	acct_resolve();
+	return alloc_acct.enter ? alloc_acct.enter(path) : 0;
+}
+
+/* restore the code path returned by acct_enter */
+static inline void acct_leave(int previous)
+{
+	if (alloc_acct.leave)
+		alloc_acct.leave(previous);
+}
+
+/* get the counters of the path, returns 0 or -1 if not available */
+static inline int acct_snapshot(enum alloc_acct_path path, struct alloc_acct_counts *counts)
+{
+	acct_resolve();
+	return alloc_acct.snapshot ? alloc_acct.snapshot(path, counts) : -1;
+}
+
+#else
+
+static inline int acct_enter(enum alloc_acct_path path) { return 0; }
+static inline void acct_leave(int previous) {}
+static inline int acct_snapshot(enum alloc_acct_path path, struct alloc_acct_counts *counts) { return -1; }
+
+#endif
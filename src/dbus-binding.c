@@ -17,13 +17,20 @@
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <pthread.h>
-#include <sys/eventfd.h>
+#include <sched.h>
+#include <stddef.h>
 #include <stdbool.h>
+#include <fnmatch.h>
 
 #include <systemd/sd-bus.h>
 #include <systemd/sd-bus-protocol.h>
+#include <systemd/sd-id128.h>
+#include <systemd/sd-daemon.h>
 #include <json-c/json.h>
 
 #define AFB_BINDING_VERSION 4
@@ -32,6 +39,13 @@
 #include <afb-helpers4/afb-data-utils.h>
 #include <pcsc-glue.h>
 #include "dbus-jsonc.h"
+#include "dbus-cache.h"
+#include "dbus-native.h"
+#include "dbus-top.h"
+#include "dbus-subs.h"
+#include "dbus-queue.h"
+#include "dbus-copy.h"
+#include "alloc-acct.h"
 
 /**
 * busnames
@@ -52,17 +66,333 @@
 */
 #define MXNRJOB 10
 
+/**
+* default half-life in seconds of the rates of top talkers
+*/
+#define TOP_HALFLIFE 10
+
+/**
+* period in milliseconds of the probes of the lag of the loops
+*/
+#define LAG_PERIOD 100
+
+/**
+* default duration in milliseconds above which the DBUS thread is reported stalled
+*/
+#define STALL_THRESHOLD 200
+
+/**
+* default count of records of the flight recorder
+*/
+#define FLIGHT_SIZE 128
+
+/**
+* default duration in milliseconds above which a request is slow
+*/
+#define SLOW_THRESHOLD 1000
+
+/**
+* minimal delay in milliseconds between two dumps of the flight recorder
+*/
+#define FLIGHT_DUMP_DELAY 10000
+
+/**
+* default deadline in milliseconds of scatter requests
+*/
+#define SCATTER_TIMEOUT 5000
+
+/**
+* default maximum estimated size in bytes of a converted message
+*/
+#define MAX_REPLY_SIZE (16 * 1024 * 1024)
+
+/**
+* default maximum count of json objects of a converted message
+*/
+#define MAX_OBJECTS 1000000
+
+/**
+* default maximum count of cached connections to the buses of users and machines
+*/
+#define BUS_CACHE_SIZE 16
+
+/**
+* default delay in milliseconds before closing an idle cached connection
+*/
+#define BUS_IDLE_TIMEOUT 30000
+
+/**
+* uid of the NFC reader connection
+*/
+#define NFC_UID "dbus-binding"
+
+/**
+* maximum count of listed NFC readers
+*/
+#define NFC_MAX_READERS 2
+
+/**
+* period of NFC reader checks in milliseconds
+*/
+#define NFC_CHECK_PERIOD 5000
+
+/**
+* count of ticks of a NFC reader check
+*/
+#define NFC_CHECK_TICKS 1
+
+/**
+* period of NFC card checks in milliseconds
+*/
+#define NFC_CARD_PERIOD 250
+
+/**
+* count of the NFC verbs, first of the verbs and only for the main API
+*/
+#define NFC_VERB_COUNT 2
+
+/**
+* default time to live in milliseconds of the values of the warm-start cache
+*/
+#define DEFAULT_WARM_CACHE_TTL 5000
+
+/**
+* delay in milliseconds before saving the changes of the warm-start cache
+*/
+#define WARM_CACHE_SAVE_DELAY 2000
+
 // nfc event
 static afb_event_t event_nfc;
 
+// nfc card event
+static afb_event_t event_nfc_card;
+
+/** upper bounds in microseconds of the buckets of histograms of durations */
+static const unsigned histo_buckets[] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 50000, 100000, 500000, 1000000 };
+#define NHISTOBUCKETS (sizeof histo_buckets / sizeof *histo_buckets)
+
+/** kinds of conversions */
+enum convkind { Conv_Signal, Conv_Reply, Conv_Kind_Count };
+
+/**
+* histogram of durations, updated atomically
+*/
+struct histogram
+{
+	/** counts per bucket, the last one for greater durations */
+	uint64_t counts[NHISTOBUCKETS + 1];
+	/** sum of durations in nanoseconds */
+	uint64_t sum;
+};
+
+/**
+* metrics of an instance, updated atomically
+*/
+struct metrics
+{
+	/** calls waiting a reply per bus (user and system) */
+	int64_t inflight[2];
+	/** reconnections per bus (user and system) */
+	uint64_t reconnects[2];
+	/** conversion times per kind */
+	struct histogram conversions[Conv_Kind_Count];
+	/** lag of the loop */
+	struct histogram lag;
+	/** count of stalls */
+	uint64_t stalls;
+	/** count of signals shed because of the limits */
+	uint64_t shed;
+	/** count of replies refused because of the limits */
+	uint64_t refused;
+	/** count of cached connections closed */
+	uint64_t evictions;
+	/** reconnections of the cached connections */
+	uint64_t cached_reconnects;
+};
+
+/**
+* interned name of the bus of a user or a machine
+*/
+struct scopename
+{
+	/** link to next */
+	struct scopename *next;
+	/** the name */
+	char name[];
+};
+
+/**
+* structure for the cached connections to the buses of users and machines
+*/
+struct busconn
+{
+	/** link to next, the most recently used first */
+	struct busconn *next;
+	/** the interned name of the bus */
+	const char *name;
+	/** the connection */
+	struct sd_bus *bus;
+	/** index of the kind of bus (user or system) */
+	int index;
+	/** count of calls waiting their reply */
+	unsigned pending;
+	/** time in nanoseconds of the last use */
+	uint64_t lastuse;
+};
+
+/**
+* structure for jobs of the DBUS thread
+*/
+struct job
+{
+	/** the request or NULL for native jobs */
+	afb_req_t req;
+	/** processing of the request */
+	void (*reqproc)(afb_req_t);
+	/** processing of native jobs */
+	void (*proc)(void*);
+	/** closure of native jobs */
+	void *closure;
+	/** code path for accounting of allocations */
+	int path;
+	/** time of queuing in nanoseconds */
+	uint64_t queued;
+	/** correlation id */
+	uint64_t correlation;
+};
+
+/** stages of the requests in the flight recorder */
+enum flightstage { Stage_Wait, Stage_Pack, Stage_Roundtrip, Stage_Unpack, Stage_Count };
+
+/**
+* record of a request in the flight recorder, written by the DBUS thread only
+*/
+struct flight_record
+{
+	/** sequence number, odd while the record is written */
+	unsigned seq;
+	/** done? */
+	bool done;
+	/** status of the reply */
+	int status;
+	/** number of the request, 0 when unused */
+	uint64_t ticket;
+	/** correlation id of the job */
+	uint64_t correlation;
+	/** cookie of the sent message or 0 */
+	uint64_t cookie;
+	/** cookie of the reply or 0 */
+	uint64_t reply_cookie;
+	/** durations in nanoseconds of the stages */
+	uint64_t stages[Stage_Count];
+	/** verb of the request */
+	char verb[16];
+	/** bus */
+	char bus[8];
+	/** destination of the message */
+	char destination[64];
+	/** member or match */
+	char member[64];
+};
+
+/**
+* call waiting its reply
+*/
+struct pendcall
+{
+	/** the request */
+	afb_req_t req;
+	/** its flight record */
+	uint64_t ticket;
+	/** time of sending in nanoseconds */
+	uint64_t sent;
+	/** selected values of the reply or NULL for all */
+	struct jsonc_select *selector;
+	/** are the timestamps replied? */
+	bool timestamps;
+	/** correlation id of the job */
+	uint64_t correlation;
+	/** are the correlation id and the cookies replied? */
+	bool correlate;
+	/** flags of the conversion profile of the reply */
+	unsigned flags;
+};
+
+/**
+* structure for items released in the DBUS thread
+*/
+struct trash
+{
+	/** link to next */
+	struct trash *next;
+	/** the release function */
+	void (*release)(struct trash*);
+};
+
+/**
+* structure for calls refreshing the warm-start cache
+*/
+struct cachecall
+{
+	/** link to next */
+	struct cachecall *next;
+	/** the instance */
+	struct instance *inst;
+	/** flags of the conversion profile */
+	unsigned flags;
+	/** count of waiting requests */
+	unsigned nreqs;
+	/** the waiting requests */
+	afb_req_t *reqs;
+	/** key of the cached value */
+	char key[];
+};
+
+/**
+* structure for the lookups of the owner of the destination of cached calls
+*/
+struct cacheowner
+{
+	/** the instance */
+	struct instance *inst;
+	/** the request */
+	afb_req_t req;
+	/** the call */
+	sd_bus_message *msg;
+	/** flags of the conversion profile */
+	unsigned flags;
+	/** key of the cached value */
+	char key[];
+};
+
 /**
 * structure for event/signal specification
 */
 struct evsigspec
 {
-	const char *busname;
-	const char *match;
-	const char *event;
+	/** the specification, its selection as text */
+	struct dbus_subs_spec subs;
+	/** the selection */
+	struct json_object *select;
+};
+
+/** envelope fields of the events of signals */
+enum envelope { Env_Bus = 1, Env_Sender = 2, Env_Path = 4, Env_Interface = 8, Env_Member = 16, Env_All = 31,
+		Env_Timestamps = 32 };
+
+/** names of the envelope fields in the order of their bits */
+static const char *envelope_names[] = { "bus", "sender", "path", "interface", "member", "timestamps" };
+
+/**
+* times of dispatch of a message by the DBUS thread
+*/
+struct stamps
+{
+	/** monotonic time in microseconds */
+	uint64_t monotonic;
+	/** realtime in microseconds */
+	uint64_t realtime;
 };
 
 /**
@@ -70,65 +400,322 @@ struct evsigspec
 */
 struct evrec
 {
-	/** link to next */
-	struct evrec *next;
+	/** the record in the subscriptions, first */
+	struct dbus_subs_evrec subs;
 	/** the event */
 	afb_event_t event;
-	/** reference count */
-	unsigned refcnt;
+	/** ordered stream of the events converted by the signal workers or NULL */
+	struct sigstream *stream;
 	/** name */
 	char name[];
 };
 
 /**
-* structure for referencing events
+* structure for watchers of signals
+*/
+struct watch
+{
+	/** the watch in the subscriptions, first */
+	struct dbus_subs_watch subs;
+	/** the instance */
+	struct instance *inst;
+	/** slot for removal */
+	sd_bus_slot *slot;
+	/** hash of the selection */
+	uint64_t selhash;
+	/** selected envelope fields */
+	unsigned envelope;
+	/** is data selected? */
+	bool data;
+	/** selected values of data or NULL for all */
+	struct jsonc_select *selector;
+	/** count of signals received */
+	uint64_t received;
+	/** count of signals converted */
+	uint64_t converted;
+	/** count of events pushed */
+	uint64_t pushed;
+	/** delays from the dispatch to the push */
+	struct histogram dispatch_to_push;
+	/** reference count, only changed in the DBUS thread */
+	unsigned refcount;
+};
+
+/**
+* structure for the events of an evrec, pushed in arrival order by the signal workers
+*/
+struct sigstream
+{
+	/** the event */
+	afb_event_t event;
+	/** reference count: the evrec and the pushes of living tasks */
+	unsigned refcount;
+	/** pending pushes in arrival order */
+	struct sigpush *head;
+	struct sigpush *tail;
+};
+
+/**
+* structure for the conversion of a signal for a selection
 */
-struct evlist
+struct sigconv
 {
 	/** link to next */
-	struct evlist *next;
-	/** link to the event */
-	struct evrec *evrec;
-	/** reference count */
-	unsigned refcnt;
+	struct sigconv *next;
+	/** the watch giving the selection */
+	struct watch *watch;
+	/** the converted event data or NULL when shed */
+	afb_data_t data;
 };
 
 /**
-* structure for watchers of signals
+* structure for an event of a signal waiting in its stream
 */
-struct watch
+struct sigpush
+{
+	/** link to next in the stream */
+	struct sigpush *next;
+	/** link to next of the task */
+	struct sigpush *tnext;
+	/** the stream */
+	struct sigstream *stream;
+	/** the task */
+	struct sigtask *task;
+	/** the conversion of the event data */
+	struct sigconv *conv;
+};
+
+/**
+* structure for a signal converted by the signal workers
+*/
+struct sigtask
+{
+	/** release in the DBUS thread */
+	struct trash trash;
+	/** link in the queue of the workers */
+	struct sigtask *next;
+	/** the instance */
+	struct instance *inst;
+	/** the message, only referenced by the DBUS thread */
+	sd_bus_message *msg;
+	/** its cookie */
+	uint64_t cookie;
+	/** its dispatch */
+	struct stamps stamps;
+	/** the conversions */
+	struct sigconv *convs;
+	/** the pushes */
+	struct sigpush *pushes;
+	/** reference count: the worker and the pending pushes */
+	unsigned refcount;
+	/** is converted? */
+	bool done;
+};
+
+/**
+* structure for the memo of the last signal converted,
+* it is shared by all the watches matching the signal
+*/
+struct sigmemo
+{
+	/** the referenced message */
+	sd_bus_message *msg;
+	/** its cookie */
+	uint64_t cookie;
+	/** the referenced watch giving the selection of its conversion */
+	struct watch *watch;
+	/** its dispatch */
+	struct stamps stamps;
+	/** the converted event data */
+	afb_data_t data;
+};
+
+/**
+* name of a bus in the registry
+*/
+struct regname
 {
 	/** link to next */
-	struct watch *next;
-	/** attached events */
-	struct evlist *evlist;
-	/** slot for removal */
-	sd_bus_slot *slot;
-	/** name of bus */
-	const char *busname;
-	/** match filter */
-	const char *match;
+	struct regname *next;
+	/** the name */
+	char name[];
+};
+
+/**
+* registry of the names of a bus, maintained from the bus daemon
+*/
+struct registry
+{
+	/** the instance */
+	struct instance *inst;
+	/** slot of the match of NameOwnerChanged */
+	sd_bus_slot *match;
+	/** slot of the pending ListNames */
+	sd_bus_slot *listing;
+	/** is the list of names complete? */
+	bool ready;
+	/** the names */
+	struct regname *names;
+	/** the scatter requests waiting the list */
+	struct scatter *waiting;
+};
+
+/**
+* structure for instances of the API,
+* each instance has its own thread, job queue, buses and subscriptions
+*/
+struct instance
+{
+	/** the API */
+	afb_api_t api;
+	/** configuration of the instance */
+	struct json_object *config;
+	/** name of the default bus */
+	const char *defbus;
+	/** mutex of the event loop and of the trash */
+	pthread_mutex_t mutex;
+	/** SD event loop */
+	sd_event *sdevlp;
+	/** size of the job queue */
+	int mxnrjob;
+	/** the job queue, its eventfd waking up the loop */
+	struct dbus_queue queue;
+	/** items to be released by the DBUS thread */
+	struct trash *trash;
+	/** the buses (user and system) */
+	struct sd_bus *buses[2];
+	/** the subscriptions: watches and events */
+	struct dbus_subs subs;
+	/** mutex for reading the list of watches from other threads */
+	pthread_mutex_t watchlock;
+	/** the list of active native subscriptions */
+	struct dbus_native_subscription *nsubs;
+	/** memo of the last signal converted */
+	struct sigmemo sigmemo;
+	/** event source releasing the memo after the dispatch */
+	sd_event_source *sigmemo_release;
+	/** timer saving the changes of the warm-start cache */
+	sd_event_source *warm_cache_saver;
+	/** the list of pending calls refreshing the warm-start cache */
+	struct cachecall *cachecalls;
+	/** the native interface */
+	struct dbus_native_v1 native;
+	/** the metrics */
+	struct metrics metrics;
+	/** top talkers of signals by sender, interface and member */
+	struct dbus_top top_signals;
+	/** top talkers of calls by destination and member */
+	struct dbus_top top_calls;
+	/** top subscribers by event */
+	struct dbus_top top_events;
+	/** timer probing the lag of the loop */
+	sd_event_source *lag_probe;
+	/** time in nanoseconds of the last probe */
+	uint64_t progress;
+	/** duration in nanoseconds above which the thread is stalled */
+	uint64_t stall_threshold;
+	/** link to the next started instance */
+	struct instance *nextinst;
+	/** the ring of records of the flight recorder */
+	struct flight_record *flight;
+	/** count of records of the flight recorder */
+	unsigned flightsize;
+	/** the last flight record */
+	uint64_t flightlast;
+	/** the flight record of the current job */
+	uint64_t flightcur;
+	/** correlation id of the current job */
+	uint64_t corrcur;
+	/** duration in nanoseconds above which a request is slow */
+	uint64_t slow_threshold;
+	/** time of the last dump of the flight recorder */
+	uint64_t flightdump;
+	/** registries of names per bus (user and system) */
+	struct registry registries[2];
+	/** maximum estimated size in bytes of a converted message or 0 */
+	size_t max_reply_size;
+	/** maximum count of json objects of a converted message or 0 */
+	size_t max_objects;
+	/** flags of the conversion profile of the signals and replies */
+	unsigned profile;
+	/** count of signal workers, 0 when signals are converted by the DBUS thread */
+	int nworkers;
+	/** mutex of the queue of the signal workers and of the streams */
+	pthread_mutex_t poollock;
+	/** condition of the signal workers */
+	pthread_cond_t poolcond;
+	/** queue of the signals to convert */
+	struct sigtask *sigqhead;
+	struct sigtask *sigqtail;
+	/** signal of the current dispatch, submitted when done */
+	struct sigtask *sigtask;
+	/** cached connections to the buses of users and machines */
+	struct busconn *busconns;
+	/** count of cached connections */
+	unsigned nbusconns;
+	/** maximum count of cached connections */
+	unsigned busconn_max;
+	/** delay in nanoseconds before closing an idle cached connection */
+	uint64_t busconn_idle;
+	/** timer closing the idle cached connections */
+	sd_event_source *busconn_sweeper;
+};
+
+/** type of the native interface */
+static afb_type_t native_type;
+
+/** list of the started instances */
+static struct instance *instances;
+
+/** last correlation id given to a job */
+static uint64_t correlations;
+
+/** interned names of the buses of users and machines */
+static struct scopename *scopenames;
+
+/** mutex of the interned names */
+static pthread_mutex_t scopelock = PTHREAD_MUTEX_INITIALIZER;
+
+/** period of the watchdog in nanoseconds or 0 when not notified */
+static uint64_t watchdog_period;
+
+/** time of the last notification of the watchdog */
+static uint64_t watchdog_last;
+
+/** budget in bytes of the converted payloads in flight or 0 when unlimited */
+static size_t memory_budget;
+
+/** estimated bytes of the converted payloads in flight */
+static size_t memory_used;
+
+/** the instance of the main API */
+static struct instance main_instance = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.watchlock = PTHREAD_MUTEX_INITIALIZER,
+	.poollock = PTHREAD_MUTEX_INITIALIZER,
+	.poolcond = PTHREAD_COND_INITIALIZER
 };
 
-/** global mutex */
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+/** path of the warm-start cache file or NULL when disabled */
+static char *warm_cache_path = NULL;
+
+/** time to live in microseconds of the values of the warm-start cache */
+static uint64_t warm_cache_ttl = DEFAULT_WARM_CACHE_TTL * 1000;
 
-/** SD event loop */
-static sd_event *sdevlp = NULL;
+/** realtime of the start, values older than it were not validated */
+static uint64_t warm_cache_start = 0;
 
-/** event loop wake up channel */
-static int efd = 0;
+/** mutex of the NFC monitor */
+static pthread_mutex_t nfc_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/** pending request jobs */
-static afb_req_t reqs[MXNRJOB];
-static void (*procs[MXNRJOB])(afb_req_t);
-static int njob = 0;
+/** is the NFC thread started? */
+static bool nfc_started = false;
 
-/** the list of activated watches */
-static struct watch *watchers = NULL;
+/** name of the connected NFC reader or NULL */
+static char *nfc_reader = NULL;
 
-/** the list of named events */
-static struct evrec *evts = NULL;
+/** cached JSON description of the card in the reader */
+static char *nfc_card = NULL;
 
 /*****************************************************************************************/
 /* helpers */
@@ -146,6 +733,12 @@ static const char *strval(struct json_object *obj, const char *key, const char *
 			: defval;
 }
 
+/* returns the instance of the API of the request */
+static struct instance *req_instance(afb_req_t req)
+{
+	return afb_api_get_userdata(afb_req_get_api(req));
+}
+
 /* creates the error object for the dbus error */
 static struct json_object *jsonc_of_dbus_error(const sd_bus_error *err)
 {
@@ -176,457 +769,2948 @@ static void removelistitem(void *item, void *pnxt)
 /* bus provider */
 /*****************************************************************************************/
 
-/* returns the standard bus name or NULL is busname is illegal */
-static const char *std_busname(const char *busname)
+/*
+ * returns the interned name of the bus of a user or a machine or NULL if illegal,
+ * the syntax being system@MACHINE, user@USER or user@USER@MACHINE
+ */
+static const char *scoped_busname(const char *busname)
 {
-	return busname == NULL ? DEFAULT_BUSNAME
-		: !strcmp(busname, BUSNAME_SYSTEM) ? BUSNAME_SYSTEM
-		: !strcmp(busname, BUSNAME_USER) ? BUSNAME_USER
-		: NULL;
-}
+	struct scopename *item;
+	const char *scope, *at;
 
-/* returns the DBUS to use */
-static struct sd_bus *getbus(const char *busname)
-{
-	static struct sd_bus *buses[2];
-	static const char *names[2] = { BUSNAME_USER, BUSNAME_SYSTEM };
-	static int (*creators[2])(struct sd_bus**);
+	if (!strncmp(busname, BUSNAME_SYSTEM "@", sizeof BUSNAME_SYSTEM)) {
+		scope = &busname[sizeof BUSNAME_SYSTEM];
+		if (*scope == 0 || strchr(scope, '@') != NULL)
+			return NULL;
+	}
+	else if (!strncmp(busname, BUSNAME_USER "@", sizeof BUSNAME_USER)) {
+		scope = &busname[sizeof BUSNAME_USER];
+		at = strchr(scope, '@');
+		if (*scope == 0 || at == scope || (at != NULL && (at[1] == 0 || strchr(&at[1], '@') != NULL)))
+			return NULL;
+	}
+	else
+		return NULL;
 
-	struct sd_bus *result = NULL;
-	int rc, index = 2;
-	for (;;) {
-		/* check if end */
-		if (!index)
-			break;
-		/* check if found */
-		if (strcmp(busname, names[--index]))
-			continue;
-		/* check if available */
-		result = buses[index];
-		if (result != NULL)
-			break;
-		/* create */
-		rc = (index ? sd_bus_default_system : sd_bus_default_user)(&result);
-		if (rc >= 0) {
-			/* attach to the main loop */
-			rc = sd_bus_attach_event(result, sdevlp, SD_EVENT_PRIORITY_NORMAL);
-			if (rc >= 0) {
-				/* record result */
-				buses[index] = result;
-				break;
-			}
-			sd_bus_unref(result);
+	pthread_mutex_lock(&scopelock);
+	for (item = scopenames ; item != NULL && strcmp(item->name, busname) ; item = item->next);
+	if (item == NULL) {
+		item = malloc(sizeof *item + 1 + strlen(busname));
+		if (item != NULL) {
+			strcpy(item->name, busname);
+			item->next = scopenames;
+			scopenames = item;
 		}
-		/* error found */
-		AFB_ERROR("creation of SDBUS %s failed", names[index]);
-		result = NULL;
-		break;
 	}
-	return result;
+	pthread_mutex_unlock(&scopelock);
+	return item == NULL ? NULL : item->name;
 }
 
-/*****************************************************************************************/
-/* DBUS thread and and its job control */
-/*****************************************************************************************/
+/* returns the standard bus name or NULL is busname is illegal */
+static const char *std_busname(struct instance *inst, const char *busname)
+{
+	return busname == NULL ? inst->defbus
+		: !strcmp(busname, BUSNAME_SYSTEM) ? BUSNAME_SYSTEM
+		: !strcmp(busname, BUSNAME_USER) ? BUSNAME_USER
+		: scoped_busname(busname);
+}
 
-/* submit a request that will be processed by  the given proc in the DBUS thread context */
-static void submit(afb_req_t req, void (*proc)(afb_req_t))
+/* is the bus of a user or a machine? */
+static bool is_scoped_busname(const char *busname)
 {
-	pthread_mutex_lock(&mutex);
-	if (sdevlp == NULL) {
-		pthread_mutex_unlock(&mutex);
-		afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
-		AFB_ERROR("No event loop");
-	}
-	else if (njob == MXNRJOB) {
-		/* ooooch! too many jobs !!! */
-		pthread_mutex_unlock(&mutex);
-		afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
-		AFB_ERROR("Too many requests");
-	}
-	else {
-		/* first, shift the pending job queue */
-		uint64_t inc = 1;
-		int jdx, idx = njob++;
-		while (idx) {
-			jdx = idx - 1;
-			reqs[idx] = reqs[jdx];
-			procs[idx] = procs[jdx];
-			idx = jdx;
-		}
-		/* add the given job */
-		reqs[0] = afb_req_addref(req);
-		procs[0] = proc;
-		pthread_mutex_unlock(&mutex);
-		/* signal the DBUS thread that a new job is queued */
-		write(efd, & inc, sizeof inc);
-	}
+	return strchr(busname, '@') != NULL;
 }
 
-/* DBUS thread simply runs the sd_event loop forever */
-static int gotjob(sd_event_source *s, int fd, uint32_t revents, void *userdata)
+/* names of the buses by index */
+static const char *busnames[2] = { BUSNAME_USER, BUSNAME_SYSTEM };
+
+/* returns the cached connection of the bus or NULL */
+static struct busconn *busconn_of(struct instance *inst, struct sd_bus *bus)
 {
-	uint64_t count;
-	afb_req_t req;
-	void (*proc)(afb_req_t);
+	struct busconn *conn = NULL;
 
-	read(efd, &count, sizeof count);
-	for (;;) {
-		pthread_mutex_lock(&mutex);
-		if (njob == 0) {
-			pthread_mutex_unlock(&mutex);
-			return 0;
-		}
-		req = reqs[--njob];
-		proc = procs[njob];
-		pthread_mutex_unlock(&mutex);
-		proc(req);
-		afb_req_unref(req);
-	}
+	if (bus != inst->buses[0] && bus != inst->buses[1])
+		for (conn = inst->busconns ; conn != NULL && conn->bus != bus ; conn = conn->next);
+	return conn;
 }
 
-/* DBUS thread simply runs the sd_event loop forever */
-static void *run(void *argh)
+/* index of the kind of the bus of the instance */
+static int bus_index(struct instance *inst, struct sd_bus *bus)
 {
-	pthread_mutex_lock(&mutex);
-	/* create the event loop */
-	int rc = sd_event_default(&sdevlp);
-	if (rc >= 0) {
-		/* attach the loop signaler */
-		rc = sd_event_add_io(sdevlp, NULL, efd, EPOLLIN, gotjob, NULL);
+	struct busconn *conn = busconn_of(inst, bus);
+	return conn != NULL ? conn->index : bus == inst->buses[1];
+}
+
+static void rematch(struct instance *inst, const char *busname, struct sd_bus *bus);
+static bool native_uses_bus(struct instance *inst, const char *busname);
+static uint64_t monotonic_nsec(void);
+
+/* is the cached connection in use by calls, matches or native subscriptions? */
+static bool busconn_pinned(struct instance *inst, struct busconn *conn)
+{
+	struct dbus_subs_watch *watch;
+
+	if (conn->pending > 0)
+		return true;
+	for (watch = inst->subs.watchers ; watch != NULL ; watch = watch->next)
+		if (!strcmp(watch->busname, conn->name))
+			return true;
+	return native_uses_bus(inst, conn->name);
+}
+
+/* close the cached connection, failing its pending calls */
+static void busconn_close(struct instance *inst, struct busconn *conn)
+{
+	while (sd_bus_process(conn->bus, NULL) > 0);
+	unlinklistitem(conn, &inst->busconns);
+	inst->nbusconns--;
+	sd_bus_flush_close_unref(conn->bus);
+	free(conn);
+}
+
+/* close the cached connections idle since the given time */
+static void busconn_sweep(struct instance *inst, uint64_t before)
+{
+	struct busconn *conn, *next;
+
+	for (conn = inst->busconns ; conn != NULL ; conn = next) {
+		next = conn->next;
+		if (conn->lastuse <= before && !busconn_pinned(inst, conn)) {
+			busconn_close(inst, conn);
+			__atomic_add_fetch(&inst->metrics.evictions, 1, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/* periodically close the idle cached connections */
+static int on_busconn_sweep(sd_event_source *s, uint64_t usec, void *userdata)
+{
+	struct instance *inst = userdata;
+	uint64_t now = monotonic_nsec();
+
+	busconn_sweep(inst, now > inst->busconn_idle ? now - inst->busconn_idle : 0);
+	if (inst->nbusconns > 0) {
+		sd_event_source_set_time(s, usec + inst->busconn_idle / 1000);
+		sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+	}
+	return 0;
+}
+
+/* evict the least recently used connection not in use, returns false if none */
+static bool busconn_evict(struct instance *inst)
+{
+	struct busconn *conn, *lru = NULL;
+
+	for (conn = inst->busconns ; conn != NULL ; conn = conn->next)
+		if (!busconn_pinned(inst, conn))
+			lru = conn;
+	if (lru == NULL)
+		return false;
+	busconn_close(inst, lru);
+	__atomic_add_fetch(&inst->metrics.evictions, 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+/* returns the cached connection to the bus of a user or a machine, opening it if needed */
+static struct sd_bus *busconn_get(struct instance *inst, const char *busname)
+{
+	struct busconn *conn;
+	struct sd_bus *bus;
+	const char *scope;
+	char *machine;
+	uint64_t now = monotonic_nsec();
+	int rc, index = !strncmp(busname, BUSNAME_SYSTEM "@", sizeof BUSNAME_SYSTEM);
+
+	/* search the connection, the found one becomes the most recently used */
+	for (conn = inst->busconns ; conn != NULL && strcmp(conn->name, busname) ; conn = conn->next);
+	if (conn != NULL) {
+		if (sd_bus_is_open(conn->bus) > 0) {
+			unlinklistitem(conn, &inst->busconns);
+			conn->next = inst->busconns;
+			inst->busconns = conn;
+			conn->lastuse = now;
+			return conn->bus;
+		}
+		/* lost connection, fail the pending calls before dropping it */
+		AFB_API_WARNING(inst->api, "connection to SDBUS %s lost, reconnecting", busname);
+		busconn_close(inst, conn);
+		__atomic_add_fetch(&inst->metrics.cached_reconnects, 1, __ATOMIC_RELAXED);
+	}
+
+	/* make room for the new connection */
+	if (inst->nbusconns >= inst->busconn_max && !busconn_evict(inst))
+		AFB_API_NOTICE(inst->api, "all the %u cached SDBUS connections are in use", inst->nbusconns);
+
+	/* open the connection, sd-bus names the user buses USER@MACHINE */
+	scope = strchr(busname, '@') + 1;
+	if (index)
+		rc = sd_bus_open_system_machine(&bus, scope);
+	else if (strchr(scope, '@') != NULL)
+		rc = sd_bus_open_user_machine(&bus, scope);
+	else if (asprintf(&machine, "%s@.host", scope) < 0)
+		rc = -ENOMEM;
+	else {
+		rc = sd_bus_open_user_machine(&bus, machine);
+		free(machine);
+	}
+	if (rc < 0)
+		goto error;
+	rc = sd_bus_attach_event(bus, inst->sdevlp, SD_EVENT_PRIORITY_NORMAL);
+	if (rc < 0)
+		goto error2;
+	conn = malloc(sizeof *conn);
+	if (conn == NULL)
+		goto error2;
+	conn->name = busname;
+	conn->bus = bus;
+	conn->index = index;
+	conn->pending = 0;
+	conn->lastuse = now;
+	conn->next = inst->busconns;
+	inst->busconns = conn;
+	inst->nbusconns++;
+
+	/* restore the matches of a previous connection */
+	rematch(inst, busname, bus);
+
+	/* close it when idle */
+	if (inst->busconn_sweeper == NULL)
+		sd_event_add_time(inst->sdevlp, &inst->busconn_sweeper, CLOCK_MONOTONIC,
+				(now + inst->busconn_idle) / 1000, 1000, on_busconn_sweep, inst);
+	else if (inst->nbusconns == 1)
+		sd_event_source_set_time(inst->busconn_sweeper, (now + inst->busconn_idle) / 1000);
+	sd_event_source_set_enabled(inst->busconn_sweeper, SD_EVENT_ONESHOT);
+	return bus;
+
+error2:
+	sd_bus_unref(bus);
+error:
+	AFB_API_ERROR(inst->api, "creation of SDBUS %s failed: %s", busname, strerror(-rc));
+	return NULL;
+}
+
+/* returns the DBUS of the instance to use */
+static struct sd_bus *getbus(struct instance *inst, const char *busname)
+{
+	const char **names = busnames;
+	struct sd_bus *result = NULL;
+	int rc, index = 2;
+
+	if (is_scoped_busname(busname))
+		return busconn_get(inst, busname);
+	for (;;) {
+		/* check if end */
+		if (!index)
+			break;
+		/* check if found */
+		if (strcmp(busname, names[--index]))
+			continue;
+		/* check if available */
+		result = inst->buses[index];
+		if (result != NULL) {
+			if (sd_bus_is_open(result) > 0)
+				break;
+			/* lost connection, fail the pending calls before dropping it */
+			AFB_API_WARNING(inst->api, "connection to SDBUS %s lost, reconnecting", names[index]);
+			while (sd_bus_process(result, NULL) > 0);
+			sd_bus_flush_close_unref(result);
+			inst->buses[index] = result = NULL;
+			__atomic_add_fetch(&inst->metrics.reconnects[index], 1, __ATOMIC_RELAXED);
+		}
+		/* create a connection owned by the instance */
+		rc = (index ? sd_bus_open_system : sd_bus_open_user)(&result);
 		if (rc >= 0) {
-			pthread_mutex_unlock(&mutex);
-			sd_event_loop(sdevlp);
-			pthread_mutex_lock(&mutex);
+			/* attach to the main loop */
+			rc = sd_bus_attach_event(result, inst->sdevlp, SD_EVENT_PRIORITY_NORMAL);
+			if (rc >= 0) {
+				/* record result */
+				inst->buses[index] = result;
+				/* restore the matches of a previous connection */
+				rematch(inst, names[index], result);
+				break;
+			}
+			sd_bus_unref(result);
+		}
+		/* error found */
+		AFB_ERROR("creation of SDBUS %s failed", names[index]);
+		result = NULL;
+		break;
+	}
+	return result;
+}
+
+/* record a call waiting its reply on the bus */
+static void call_sent(struct instance *inst, struct sd_bus *bus)
+{
+	struct busconn *conn = busconn_of(inst, bus);
+	if (conn != NULL)
+		conn->pending++;
+	__atomic_add_fetch(&inst->metrics.inflight[conn != NULL ? conn->index : bus == inst->buses[1]], 1, __ATOMIC_RELAXED);
+}
+
+/* record the reply of a call */
+static void call_replied(struct instance *inst, sd_bus_message *reply)
+{
+	struct sd_bus *bus = sd_bus_message_get_bus(reply);
+	struct busconn *conn = busconn_of(inst, bus);
+	if (conn != NULL)
+		conn->pending--;
+	__atomic_sub_fetch(&inst->metrics.inflight[conn != NULL ? conn->index : bus == inst->buses[1]], 1, __ATOMIC_RELAXED);
+}
+
+/* monotonic time in nanoseconds */
+static uint64_t monotonic_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* returns the realtime in microseconds */
+static uint64_t realtime_usec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/*
+ * get the times of dispatch of a message, now being its monotonic time in nanoseconds
+ * sd-bus gives no time of reception on the sockets of the buses
+ */
+static void get_stamps(uint64_t now, struct stamps *stamps)
+{
+	stamps->monotonic = now / 1000;
+	stamps->realtime = realtime_usec() - (monotonic_nsec() - now) / 1000;
+}
+
+/* creates the object of the times of dispatch and of push */
+static struct json_object *jsonc_of_stamps(const struct stamps *stamps)
+{
+	struct json_object *obj = json_object_new_object();
+	json_object_object_add(obj, "dispatched", json_object_new_int64((int64_t)stamps->monotonic));
+	json_object_object_add(obj, "dispatched-realtime", json_object_new_int64((int64_t)stamps->realtime));
+	json_object_object_add(obj, "pushed", json_object_new_int64((int64_t)(monotonic_nsec() / 1000)));
+	return obj;
+}
+
+/* record the duration in the histogram */
+static void histogram_add(struct histogram *histo, uint64_t duration)
+{
+	unsigned idx = 0;
+	while (idx < NHISTOBUCKETS && duration > histo_buckets[idx] * (uint64_t)1000)
+		idx++;
+	__atomic_add_fetch(&histo->counts[idx], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&histo->sum, duration, __ATOMIC_RELAXED);
+}
+
+/* record a hit in the top talkers */
+static void top_hit(struct dbus_top *top, unsigned nparts, const char *parts[])
+{
+	dbus_top_hit(top, monotonic_nsec(), nparts, parts);
+}
+
+/* report the DBUS thread stalled if the duration since start is too long */
+static void stall_check(struct instance *inst, uint64_t start, const char *what, const char *detail)
+{
+	uint64_t duration = monotonic_nsec() - start;
+	if (duration >= inst->stall_threshold) {
+		__atomic_add_fetch(&inst->metrics.stalls, 1, __ATOMIC_RELAXED);
+		AFB_API_WARNING(inst->api, "DBUS thread stalled %llu ms by %s %s",
+				(unsigned long long)(duration / 1000000), what, detail ?: "");
+	}
+}
+
+/*
+ * get in flags the conversion profile of the given name:
+ * "standard" keeps the shape of the signature, "compact" unwraps
+ * the variants and the bodies of a single value
+ */
+static int profile_of(const char *name, unsigned *flags)
+{
+	if (!strcmp(name, "standard"))
+		*flags = 0;
+	else if (!strcmp(name, "compact"))
+		*flags = MSG2JSONC_COMPACT;
+	else
+		return -1;
+	return 0;
+}
+
+/*
+ * converts the selected values of the message to json using the profile flags,
+ * recording the conversion time
+ * returns -E2BIG when the limits of the instance or the memory budget are exceeded
+ * otherwise the estimated size of the result is stored in size
+ */
+static int timed_msg2jsonc(struct instance *inst, enum convkind kind, sd_bus_message *msg,
+		const struct jsonc_select *select, unsigned flags, struct json_object **result, size_t *size)
+{
+	struct jsonc_limits limits = { .max_size = inst->max_reply_size, .max_count = inst->max_objects };
+	size_t used;
+	uint64_t start;
+	int rc;
+
+	/* the remaining budget restricts the size */
+	if (memory_budget != 0) {
+		used = __atomic_load_n(&memory_used, __ATOMIC_RELAXED);
+		if (used >= memory_budget) {
+			*result = NULL;
+			return -E2BIG;
+		}
+		if (limits.max_size == 0 || limits.max_size > memory_budget - used)
+			limits.max_size = memory_budget - used;
+	}
+
+	start = monotonic_nsec();
+	rc = msg2jsonc_limited(msg, select, &limits, flags, result);
+	histogram_add(&inst->metrics.conversions[kind], monotonic_nsec() - start);
+	*size = limits.size;
+	return rc;
+}
+
+/** a converted payload charged to the memory budget */
+struct charge
+{
+	/** the payload */
+	struct json_object *obj;
+	/** its estimated size */
+	size_t size;
+};
+
+/* release the payload and its charge */
+static void charge_release(void *closure)
+{
+	struct charge *charge = closure;
+	__atomic_sub_fetch(&memory_used, charge->size, __ATOMIC_RELAXED);
+	json_object_put(charge->obj);
+	free(charge);
+}
+
+/* make the data of the converted payload of size charged to the budget until released */
+static afb_data_t charged_data(struct json_object *obj, size_t size)
+{
+	struct charge *charge;
+	afb_data_t data;
+
+	if (memory_budget == 0 || obj == NULL || (charge = malloc(sizeof *charge)) == NULL)
+		afb_create_data_raw(&data, AFB_PREDEFINED_TYPE_JSON_C, obj, 0, (void*)json_object_put, obj);
+	else {
+		charge->obj = obj;
+		charge->size = size;
+		__atomic_add_fetch(&memory_used, size, __ATOMIC_RELAXED);
+		afb_create_data_raw(&data, AFB_PREDEFINED_TYPE_JSON_C, obj, 0, charge_release, charge);
+	}
+	return data;
+}
+
+/* the error replied when the limits are exceeded */
+static struct json_object *jsonc_of_limits_error(void)
+{
+	sd_bus_error err = SD_BUS_ERROR_MAKE_CONST(SD_BUS_ERROR_LIMITS_EXCEEDED,
+					"the reply exceeds the limits of conversion");
+	return jsonc_of_dbus_error(&err);
+}
+
+/*****************************************************************************************/
+/* flight recorder */
+/*****************************************************************************************/
+
+/* start writing the record of the ticket, returns NULL if overwritten */
+static struct flight_record *flight_write(struct instance *inst, uint64_t ticket)
+{
+	struct flight_record *rec;
+
+	if (ticket == 0)
+		return NULL;
+	rec = &inst->flight[ticket % inst->flightsize];
+	if (rec->ticket != ticket)
+		return NULL;
+	__atomic_store_n(&rec->seq, rec->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return rec;
+}
+
+/* end writing the record */
+static void flight_written(struct flight_record *rec)
+{
+	__atomic_store_n(&rec->seq, rec->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* copy the record written by the DBUS thread, returns false if not available */
+static bool flight_read(const struct flight_record *rec, struct flight_record *copy)
+{
+	unsigned seq, tries;
+
+	for (tries = 0 ; tries < 10 ; tries++) {
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1)) {
+			memcpy(copy, rec, sizeof *copy);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (seq == __atomic_load_n(&rec->seq, __ATOMIC_RELAXED))
+				return copy->ticket != 0;
+		}
+		sched_yield();
+	}
+	return false;
+}
+
+/* start the record of the current job */
+static void flight_begin(struct instance *inst, const char *verb, uint64_t wait, uint64_t correlation)
+{
+	struct flight_record *rec;
+	uint64_t ticket;
+
+	if (inst->flight == NULL)
+		return;
+	ticket = ++inst->flightlast;
+	rec = &inst->flight[ticket % inst->flightsize];
+	__atomic_store_n(&rec->seq, rec->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	rec->ticket = ticket;
+	rec->correlation = correlation;
+	rec->cookie = rec->reply_cookie = 0;
+	rec->done = false;
+	rec->status = 0;
+	memset(rec->stages, 0, sizeof rec->stages);
+	rec->stages[Stage_Wait] = wait;
+	snprintf(rec->verb, sizeof rec->verb, "%s", verb);
+	rec->bus[0] = rec->destination[0] = rec->member[0] = 0;
+	flight_written(rec);
+	inst->flightcur = ticket;
+}
+
+/* set the target of the request */
+static void flight_target(struct instance *inst, uint64_t ticket, const char *bus, const char *destination, const char *member)
+{
+	struct flight_record *rec = flight_write(inst, ticket);
+	if (rec != NULL) {
+		snprintf(rec->bus, sizeof rec->bus, "%s", bus ?: "");
+		snprintf(rec->destination, sizeof rec->destination, "%s", destination ?: "");
+		snprintf(rec->member, sizeof rec->member, "%s", member ?: "");
+		flight_written(rec);
+	}
+}
+
+/* set the duration of the stage of the request */
+static void flight_stage(struct instance *inst, uint64_t ticket, enum flightstage stage, uint64_t duration)
+{
+	struct flight_record *rec = flight_write(inst, ticket);
+	if (rec != NULL) {
+		rec->stages[stage] = duration;
+		flight_written(rec);
+	}
+}
+
+/* set the cookies of the sent message and of its reply when not zero */
+static void flight_cookies(struct instance *inst, uint64_t ticket, uint64_t cookie, uint64_t reply_cookie)
+{
+	struct flight_record *rec = flight_write(inst, ticket);
+
+	if (rec != NULL) {
+		if (cookie != 0)
+			rec->cookie = cookie;
+		if (reply_cookie != 0)
+			rec->reply_cookie = reply_cookie;
+		flight_written(rec);
+	}
+}
+
+/* take the record of the current job for completing it later */
+static uint64_t flight_take(struct instance *inst)
+{
+	uint64_t ticket = inst->flightcur;
+	inst->flightcur = 0;
+	return ticket;
+}
+
+/* log the record */
+static void flight_log(struct instance *inst, const struct flight_record *rec)
+{
+	AFB_API_NOTICE(inst->api, "flight #%llu corr=%llu cookie=%llu reply=%llu %s %s %s %s"
+			" wait=%lluus pack=%lluus roundtrip=%lluus unpack=%lluus %s %d",
+		(unsigned long long)rec->ticket, (unsigned long long)rec->correlation,
+		(unsigned long long)rec->cookie, (unsigned long long)rec->reply_cookie,
+		rec->verb, rec->bus, rec->destination, rec->member,
+		(unsigned long long)(rec->stages[Stage_Wait] / 1000), (unsigned long long)(rec->stages[Stage_Pack] / 1000),
+		(unsigned long long)(rec->stages[Stage_Roundtrip] / 1000), (unsigned long long)(rec->stages[Stage_Unpack] / 1000),
+		rec->done ? "status" : "pending", rec->status);
+}
+
+/* compare the records by their tickets */
+static int flight_cmp(const void *a, const void *b)
+{
+	const struct flight_record *ra = a, *rb = b;
+	return (ra->ticket > rb->ticket) - (ra->ticket < rb->ticket);
+}
+
+/* copy the valid records ordered from the oldest, returns their count */
+static unsigned flight_snapshot(struct instance *inst, struct flight_record *copies)
+{
+	unsigned idx, count = 0;
+
+	for (idx = 0 ; idx < inst->flightsize ; idx++)
+		if (flight_read(&inst->flight[idx], &copies[count]))
+			count++;
+	qsort(copies, count, sizeof *copies, flight_cmp);
+	return count;
+}
+
+/* the request of the record is slow, log the recorder or at least the record */
+static void flight_slow(struct instance *inst, const struct flight_record *rec)
+{
+	struct flight_record *copies;
+	uint64_t now = monotonic_nsec();
+	unsigned idx, count;
+
+	copies = NULL;
+	if (now - inst->flightdump >= FLIGHT_DUMP_DELAY * (uint64_t)1000000)
+		copies = malloc(inst->flightsize * sizeof *copies);
+	if (copies == NULL) {
+		AFB_API_WARNING(inst->api, "slow request #%llu", (unsigned long long)rec->ticket);
+		flight_log(inst, rec);
+	}
+	else {
+		inst->flightdump = now;
+		AFB_API_WARNING(inst->api, "slow request #%llu, dumping the flight recorder", (unsigned long long)rec->ticket);
+		count = flight_snapshot(inst, copies);
+		for (idx = 0 ; idx < count ; idx++)
+			flight_log(inst, &copies[idx]);
+		free(copies);
+	}
+}
+
+/* terminate the record of the request */
+static void flight_end(struct instance *inst, uint64_t ticket, int status)
+{
+	struct flight_record *rec = flight_write(inst, ticket);
+	uint64_t total;
+	int idx;
+
+	if (ticket == inst->flightcur)
+		inst->flightcur = 0;
+	if (rec != NULL) {
+		rec->done = true;
+		rec->status = status;
+		flight_written(rec);
+		for (total = 0, idx = 0 ; idx < Stage_Count ; idx++)
+			total += rec->stages[idx];
+		if (total >= inst->slow_threshold)
+			flight_slow(inst, rec);
+	}
+}
+
+/*****************************************************************************************/
+/* DBUS thread and and its job control */
+/*****************************************************************************************/
+
+/* signal the DBUS thread of the instance that a job or a trash is pending */
+static void wake(struct instance *inst)
+{
+	int rc = dbus_queue_wake(&inst->queue);
+	if (rc < 0)
+		AFB_API_ERROR(inst->api, "can't wake the DBUS thread: %s", strerror(-rc));
+}
+
+/* queue a job that will be processed in the DBUS thread context of the instance */
+static int queue_job(struct instance *inst, const struct job *job)
+{
+	struct job queued = *job;
+	int rc;
+
+	queued.queued = monotonic_nsec();
+	queued.correlation = __atomic_add_fetch(&correlations, 1, __ATOMIC_RELAXED);
+	rc = dbus_queue_put(&inst->queue, &queued);
+	if (rc == 0)
+		wake(inst);
+	return rc;
+}
+
+/* give an item to be released in the DBUS thread context of the instance */
+static void post_trash(struct instance *inst, struct trash *trash)
+{
+	pthread_mutex_lock(&inst->mutex);
+	trash->next = inst->trash;
+	inst->trash = trash;
+	pthread_mutex_unlock(&inst->mutex);
+	wake(inst);
+}
+
+/* submit a request that will be processed by  the given proc in the DBUS thread context */
+static void submit(afb_req_t req, void (*proc)(afb_req_t), enum alloc_acct_path path)
+{
+	struct job job = { .req = afb_req_addref(req), .reqproc = proc, .path = path };
+	int rc = queue_job(req_instance(req), &job);
+	if (rc < 0) {
+		afb_req_unref(req);
+		afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
+		AFB_ERROR(rc == -EBUSY ? "Too many requests" : "No event loop");
+	}
+}
+
+/* DBUS thread simply runs the sd_event loop forever */
+static int gotjob(sd_event_source *s, int fd, uint32_t revents, void *userdata)
+{
+	struct instance *inst = userdata;
+	struct job job;
+	struct trash *trash, *next;
+	uint64_t start;
+	int prevpath, rc;
+
+	rc = dbus_queue_wait(&inst->queue);
+	if (rc < 0)
+		AFB_API_ERROR(inst->api, "can't read the wakeup of the DBUS thread: %s", strerror(-rc));
+	for (;;) {
+		if (!dbus_queue_get(&inst->queue, &job)) {
+			pthread_mutex_lock(&inst->mutex);
+			trash = inst->trash;
+			inst->trash = NULL;
+			pthread_mutex_unlock(&inst->mutex);
+			for ( ; trash != NULL ; trash = next) {
+				next = trash->next;
+				trash->release(trash);
+			}
+			return 0;
+		}
+		prevpath = acct_enter(job.path);
+		start = monotonic_nsec();
+		if (job.req == NULL) {
+			inst->corrcur = job.correlation;
+			flight_begin(inst, "native", start - job.queued, job.correlation);
+			job.proc(job.closure);
+			stall_check(inst, start, "native job", NULL);
 		}
-		sd_event_unref(sdevlp);
-		sdevlp = NULL;
+		else {
+			inst->corrcur = job.correlation;
+			flight_begin(inst, afb_req_get_called_verb(job.req), start - job.queued, job.correlation);
+			job.reqproc(job.req);
+			stall_check(inst, start, "request", afb_req_get_called_verb(job.req));
+			afb_req_unref(job.req);
+		}
+		flight_end(inst, inst->flightcur, 0);
+		acct_leave(prevpath);
+	}
+}
+
+/* probe the lag of the loop and notify the watchdog of its progress */
+static int on_lag_probe(sd_event_source *s, uint64_t usec, void *userdata)
+{
+	struct instance *inst = userdata, *it;
+	uint64_t now = monotonic_nsec(), lag = now - usec * 1000;
+
+	histogram_add(&inst->metrics.lag, lag);
+	__atomic_store_n(&inst->progress, now, __ATOMIC_RELAXED);
+
+	/* next probe is periodic unless too late */
+	usec += LAG_PERIOD * 1000;
+	if (usec * 1000 <= now)
+		usec = now / 1000 + LAG_PERIOD * 1000;
+	sd_event_source_set_time(s, usec);
+
+	/* the watchdog is notified when all the loops progress */
+	if (watchdog_period != 0 && inst == &main_instance && now - watchdog_last >= watchdog_period / 4) {
+		for (it = __atomic_load_n(&instances, __ATOMIC_ACQUIRE) ; it != NULL ; it = it->nextinst)
+			if (now - __atomic_load_n(&it->progress, __ATOMIC_RELAXED) > watchdog_period / 2)
+				return 0;
+		sd_notify(0, "WATCHDOG=1");
+		watchdog_last = now;
 	}
-	pthread_mutex_unlock(&mutex);
+	return 0;
+}
+
+/* DBUS thread runs the sd_event loop of its instance forever, checking the dispatches */
+static void *run(void *argh)
+{
+	struct instance *inst = argh;
+	uint64_t start, stalls;
+	int rc;
+
+	do {
+		rc = sd_event_prepare(inst->sdevlp);
+		if (rc == 0)
+			rc = sd_event_wait(inst->sdevlp, (uint64_t)-1);
+		if (rc > 0) {
+			/* report stalls not already reported by the dispatched callback */
+			stalls = __atomic_load_n(&inst->metrics.stalls, __ATOMIC_RELAXED);
+			start = monotonic_nsec();
+			rc = sd_event_dispatch(inst->sdevlp);
+			if (stalls == __atomic_load_n(&inst->metrics.stalls, __ATOMIC_RELAXED))
+				stall_check(inst, start, "dispatch", NULL);
+		}
+	} while (rc >= 0 && sd_event_get_state(inst->sdevlp) != SD_EVENT_FINISHED);
+	dbus_queue_close(&inst->queue);
+	pthread_mutex_lock(&inst->mutex);
+	sd_event_unref(inst->sdevlp);
+	inst->sdevlp = NULL;
+	pthread_mutex_unlock(&inst->mutex);
 	return NULL;
 }
 
 /*****************************************************************************************/
-/* manage afb event records (evrec) */
+/* selection of the converted values */
 /*****************************************************************************************/
 
-/* search in the list */
-static struct evrec *search_evrec(const char *name)
+/* parse the selection, an array of envelope fields (for signals), "data" or paths of values */
+static int select_parse(struct json_object *select, bool signal, unsigned *envelope, bool *data, struct jsonc_select **selector)
 {
-	struct evrec *evrec = evts;
-	while(evrec != NULL && strcmp(name, evrec->name))
-		evrec = evrec->next;
-	return evrec;
+	const char *item;
+	size_t idx, count;
+	unsigned env;
+	bool alldata;
+
+	*selector = NULL;
+	if (select == NULL) {
+		*envelope = Env_All;
+		*data = true;
+		return 0;
+	}
+	if (!json_object_is_type(select, json_type_array))
+		return -1;
+	/* an empty selection would select nothing */
+	count = json_object_array_length(select);
+	if (count == 0)
+		return -1;
+	*envelope = 0;
+	alldata = false;
+	for (idx = 0 ; idx < count ; idx++) {
+		item = json_object_get_string(json_object_array_get_idx(select, idx));
+		if (item == NULL)
+			goto error;
+		if (!strcmp(item, "data"))
+			alldata = true;
+		else if (*item >= '0' && *item <= '9') {
+			if (jsonc_select_add(selector, item) < 0)
+				goto error;
+		}
+		else {
+			for (env = 0 ; env < sizeof envelope_names / sizeof *envelope_names ; env++)
+				if (!strcmp(item, envelope_names[env]))
+					break;
+			if (!signal || env == sizeof envelope_names / sizeof *envelope_names)
+				goto error;
+			*envelope |= 1u << env;
+		}
+	}
+	*data = alldata || *selector != NULL;
+	if (alldata) {
+		jsonc_select_destroy(*selector);
+		*selector = NULL;
+	}
+	return 0;
+error:
+	jsonc_select_destroy(*selector);
+	*selector = NULL;
+	return -1;
+}
+
+/* check the selection */
+static bool select_valid(struct json_object *select, bool signal)
+{
+	struct jsonc_select *selector;
+	unsigned envelope;
+	bool data;
+
+	if (select_parse(select, signal, &envelope, &data, &selector) < 0)
+		return false;
+	jsonc_select_destroy(selector);
+	return true;
+}
+
+/* text of the selection, identifying it */
+static const char *select_text(struct json_object *select)
+{
+	return select == NULL ? "" : json_object_to_json_string_ext(select, JSON_C_TO_STRING_PLAIN);
+}
+
+/* hash of the text of the selection (FNV-1a) */
+static uint64_t select_hash(const char *text)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	while (*text)
+		hash = (hash ^ (unsigned char)*text++) * 1099511628211ULL;
+	return hash;
+}
+
+/*****************************************************************************************/
+/* manage afb event records (evrec) */
+/*****************************************************************************************/
+
+/* create the record of the event */
+static struct dbus_subs_evrec *create_evrec(void *closure, const char *name)
+{
+	struct instance *inst = closure;
+	struct evrec *evrec = malloc(sizeof *evrec + 1 + strlen(name));
+	if (evrec == NULL)
+		return NULL;
+	if (afb_api_new_event(inst->api, name, &evrec->event) < 0) {
+		free(evrec);
+		return NULL;
+	}
+	evrec->subs.name = strcpy(evrec->name, name);
+	evrec->stream = NULL;
+	return &evrec->subs;
+}
+
+/*****************************************************************************************/
+/* manage dbus matchers (watch) */
+/*****************************************************************************************/
+
+/* create the watch of the specification */
+static struct dbus_subs_watch *create_watch(void *closure, const struct dbus_subs_spec *spec)
+{
+	struct instance *inst = closure;
+	const struct evsigspec *evs = (const struct evsigspec*)spec;
+	struct watch *watch;
+	int prevpath = acct_enter(Acct_Watch);
+	watch = malloc(sizeof *watch + 3 + strlen(spec->busname) + strlen(spec->match) + strlen(spec->select));
+	if (watch != NULL && select_parse(evs->select, true, &watch->envelope, &watch->data, &watch->selector) < 0) {
+		free(watch);
+		watch = NULL;
+	}
+	if (watch != NULL) {
+		char *p = (char*)&watch[1];
+		watch->subs.busname = p;
+		p = 1 + stpcpy(p, spec->busname);
+		watch->subs.match = p;
+		p = 1 + stpcpy(p, spec->match);
+		watch->subs.select = p;
+		p = 1 + stpcpy(p, spec->select);
+		watch->selhash = select_hash(spec->select);
+		watch->inst = inst;
+		watch->slot = NULL;
+		watch->received = watch->converted = watch->pushed = 0;
+		memset(&watch->dispatch_to_push, 0, sizeof watch->dispatch_to_push);
+		watch->refcount = 1;
+	}
+	acct_leave(prevpath);
+	return watch == NULL ? NULL : &watch->subs;
+}
+
+/* drop a reference to the watch */
+static void watch_unref(struct watch *watch)
+{
+	if (--watch->refcount == 0) {
+		jsonc_select_destroy(watch->selector);
+		free(watch);
+	}
+}
+
+/* do the watches select the same values? */
+static bool same_select(const struct watch *a, const struct watch *b)
+{
+	return a->selhash == b->selhash && !strcmp(a->subs.select, b->subs.select);
+}
+
+/*****************************************************************************************/
+/* signal workers */
+/*****************************************************************************************/
+
+static afb_data_t make_signal_data(struct watch *watch, sd_bus_message *msg, const struct stamps *stamps);
+static int on_sigmemo_release(sd_event_source *s, void *userdata);
+
+/* count and log, less and less often, the signals shed */
+static void signal_shed(struct instance *inst, sd_bus_message *msg)
+{
+	uint64_t shed = __atomic_add_fetch(&inst->metrics.shed, 1, __ATOMIC_RELAXED);
+	if ((shed & (shed - 1)) == 0)
+		AFB_API_WARNING(inst->api, "%llu signals shed, last %s.%s exceeding the limits of conversion",
+			(unsigned long long)shed, sd_bus_message_get_interface(msg), sd_bus_message_get_member(msg));
+}
+
+/* drop a reference to the stream, with the lock of the pool */
+static void sigstream_unref(struct sigstream *stream)
+{
+	if (--stream->refcount == 0) {
+		afb_event_unref(stream->event);
+		free(stream);
+	}
+}
+
+/* push the converted events at the head of the stream, with the lock of the pool */
+static void sigstream_flush(struct sigstream *stream)
+{
+	struct sigpush *push;
+	struct sigtask *task;
+	afb_data_t data;
+
+	while ((push = stream->head) != NULL && push->task->done) {
+		stream->head = push->next;
+		data = push->conv->data;
+		if (data != NULL) {
+			afb_data_addref(data);
+			afb_event_push(stream->event, 1, &data);
+			__atomic_add_fetch(&push->conv->watch->pushed, 1, __ATOMIC_RELAXED);
+			histogram_add(&push->conv->watch->dispatch_to_push, monotonic_nsec() - push->task->stamps.monotonic * 1000);
+		}
+		task = push->task;
+		if (--task->refcount == 0)
+			post_trash(task->inst, &task->trash);
+	}
+}
+
+/* release the task in the DBUS thread */
+static void sigtask_release(struct trash *trash)
+{
+	struct sigtask *task = (struct sigtask*)trash;
+	struct instance *inst = task->inst;
+	struct sigpush *push;
+	struct sigconv *conv;
+
+	pthread_mutex_lock(&inst->poollock);
+	while ((push = task->pushes) != NULL) {
+		task->pushes = push->tnext;
+		sigstream_unref(push->stream);
+		free(push);
+	}
+	pthread_mutex_unlock(&inst->poollock);
+	while ((conv = task->convs) != NULL) {
+		task->convs = conv->next;
+		afb_data_unref(conv->data);
+		watch_unref(conv->watch);
+		free(conv);
+	}
+	sd_bus_message_unref(task->msg);
+	free(task);
+}
+
+/* convert the message of the task and push the events of its streams in order */
+static void sigtask_convert(struct instance *inst, struct sigtask *task)
+{
+	struct sigconv *conv;
+	struct sigpush *push;
+
+	for (conv = task->convs ; conv != NULL ; conv = conv->next) {
+		sd_bus_message_rewind(task->msg, 1);
+		conv->data = make_signal_data(conv->watch, task->msg, &task->stamps);
+		if (conv->data == NULL)
+			signal_shed(inst, task->msg);
+	}
+
+	pthread_mutex_lock(&inst->poollock);
+	task->done = true;
+	for (push = task->pushes ; push != NULL ; push = push->tnext)
+		sigstream_flush(push->stream);
+	if (--task->refcount == 0)
+		post_trash(inst, &task->trash);
+	pthread_mutex_unlock(&inst->poollock);
+}
+
+/* give the signal of the current dispatch to the workers */
+static void sigtask_submit(struct instance *inst)
+{
+	struct sigtask *task = inst->sigtask;
+
+	if (task != NULL) {
+		inst->sigtask = NULL;
+		pthread_mutex_lock(&inst->poollock);
+		task->next = NULL;
+		if (inst->sigqhead == NULL)
+			inst->sigqhead = task;
+		else
+			inst->sigqtail->next = task;
+		inst->sigqtail = task;
+		pthread_cond_signal(&inst->poolcond);
+		pthread_mutex_unlock(&inst->poollock);
+	}
+}
+
+/* add the events of the watch to the task of the signal, the message being converted once per selection */
+static void sigtask_add(struct instance *inst, struct watch *watch, sd_bus_message *msg, uint64_t cookie, uint64_t now)
+{
+	struct sigtask *task = inst->sigtask;
+	struct sigconv *conv;
+	struct sigpush *push;
+	struct dbus_subs_evlist *evlist;
+	struct evrec *evrec;
+
+	/* one task per message */
+	if (task != NULL && (task->msg != msg || task->cookie != cookie)) {
+		sigtask_submit(inst);
+		task = NULL;
+	}
+	if (task == NULL) {
+		task = calloc(1, sizeof *task);
+		if (task == NULL) {
+			signal_shed(inst, msg);
+			return;
+		}
+		task->trash.release = sigtask_release;
+		task->inst = inst;
+		task->msg = sd_bus_message_ref(msg);
+		task->cookie = cookie;
+		get_stamps(now, &task->stamps);
+		task->refcount = 1;
+		inst->sigtask = task;
+		top_hit(&inst->top_signals, 3, (const char*[]){ sd_bus_message_get_sender(msg),
+				sd_bus_message_get_interface(msg), sd_bus_message_get_member(msg) });
+		if (inst->sigmemo_release != NULL
+		 || sd_event_add_defer(inst->sdevlp, &inst->sigmemo_release, on_sigmemo_release, inst) >= 0)
+			sd_event_source_set_enabled(inst->sigmemo_release, SD_EVENT_ONESHOT);
+	}
+
+	/* the conversion of the selection */
+	for (conv = task->convs ; conv != NULL && !same_select(conv->watch, watch) ; conv = conv->next);
+	if (conv == NULL) {
+		conv = calloc(1, sizeof *conv);
+		if (conv == NULL) {
+			signal_shed(inst, msg);
+			goto end;
+		}
+		conv->watch = watch;
+		watch->refcount++;
+		conv->next = task->convs;
+		task->convs = conv;
+	}
+
+	/* queue the events in their streams */
+	for (evlist = watch->subs.evlist ; evlist != NULL ; evlist = evlist->next) {
+		evrec = (struct evrec*)evlist->evrec;
+		if (evrec->stream == NULL) {
+			evrec->stream = calloc(1, sizeof *evrec->stream);
+			if (evrec->stream == NULL)
+				continue;
+			evrec->stream->event = afb_event_addref(evrec->event);
+			evrec->stream->refcount = 1;
+		}
+		push = malloc(sizeof *push);
+		if (push == NULL)
+			continue;
+		push->next = NULL;
+		push->stream = evrec->stream;
+		push->task = task;
+		push->conv = conv;
+		push->tnext = task->pushes;
+		task->pushes = push;
+		pthread_mutex_lock(&inst->poollock);
+		push->stream->refcount++;
+		task->refcount++;
+		if (push->stream->head == NULL)
+			push->stream->head = push;
+		else
+			push->stream->tail->next = push;
+		push->stream->tail = push;
+		pthread_mutex_unlock(&inst->poollock);
+		top_hit(&inst->top_events, 1, (const char*[]){ evrec->name });
+	}
+end:
+	/* without the deferred release, the workers can't get the message after
+	 * its dispatch, which still reads it, so it is converted now */
+	if (inst->sigmemo_release == NULL) {
+		inst->sigtask = NULL;
+		sigtask_convert(inst, task);
+	}
+}
+
+/* the signal workers convert the messages and push the events of their streams in order */
+static void *sigworker(void *arg)
+{
+	struct instance *inst = arg;
+	struct sigtask *task;
+
+	pthread_mutex_lock(&inst->poollock);
+	for (;;) {
+		while ((task = inst->sigqhead) == NULL)
+			pthread_cond_wait(&inst->poolcond, &inst->poollock);
+		inst->sigqhead = task->next;
+		pthread_mutex_unlock(&inst->poollock);
+
+		/* the dispatch of the message is over and the executors read copies,
+		 * so the message is only read by this worker */
+		sigtask_convert(inst, task);
+		pthread_mutex_lock(&inst->poollock);
+	}
+	return NULL;
+}
+
+/*****************************************************************************************/
+/* manage subscriptions */
+/*****************************************************************************************/
+
+/* forget the memorized signal */
+static void sigmemo_clear(struct sigmemo *sigmemo)
+{
+	if (sigmemo->msg != NULL) {
+		afb_data_unref(sigmemo->data);
+		sd_bus_message_unref(sigmemo->msg);
+		watch_unref(sigmemo->watch);
+		sigmemo->msg = NULL;
+		sigmemo->data = NULL;
+		sigmemo->watch = NULL;
+	}
+}
+
+/* release the memo once the dispatch of the signal is done */
+static int on_sigmemo_release(sd_event_source *s, void *userdata)
+{
+	struct instance *inst = userdata;
+
+	sigmemo_clear(&inst->sigmemo);
+	sigtask_submit(inst);
+	return 0;
+}
+
+/* make the event data for the received DBUS signal */
+static afb_data_t make_signal_data(struct watch *watch, sd_bus_message *msg, const struct stamps *stamps)
+{
+	struct json_object *obj, *data = NULL;
+	afb_data_t adat;
+	int rc = -1, prevpath = acct_enter(Acct_Envelope);
+	const sd_bus_error *err;
+	size_t size = 0;
+
+	/* check if error */
+	err = sd_bus_message_get_error(msg);
+	if (err != NULL)
+		data = jsonc_of_dbus_error(err);
+	else if (watch->data) {
+		rc = timed_msg2jsonc(watch->inst, Conv_Signal, msg, watch->selector, watch->inst->profile, &data, &size);
+		if (rc == -E2BIG) {
+			/* shed the signal */
+			acct_leave(prevpath);
+			return NULL;
+		}
+	}
+	else
+		rc = 0;
+	__atomic_add_fetch(&watch->converted, 1, __ATOMIC_RELAXED);
+
+	/* make the sent event with the selected fields */
+	obj = json_object_new_object();
+	if (watch->envelope & Env_Bus)
+		json_object_object_add(obj, "bus", json_object_new_string(watch->subs.busname));
+	json_object_object_add(obj, "status", json_object_new_string(rc >= 0 ? "success" : "error"));
+	if (watch->data || err != NULL)
+		json_object_object_add(obj, "data", data);
+	if (watch->envelope & Env_Sender)
+		json_object_object_add(obj, "sender",    json_object_new_string(sd_bus_message_get_sender(msg)));
+	if (watch->envelope & Env_Path)
+		json_object_object_add(obj, "path",      json_object_new_string(sd_bus_message_get_path(msg)));
+	if (watch->envelope & Env_Interface)
+		json_object_object_add(obj, "interface", json_object_new_string(sd_bus_message_get_interface(msg)));
+	if (watch->envelope & Env_Member)
+		json_object_object_add(obj, "member",    json_object_new_string(sd_bus_message_get_member(msg)));
+	if (watch->envelope & Env_Timestamps)
+		json_object_object_add(obj, "timestamps", jsonc_of_stamps(stamps));
+
+	adat = charged_data(obj, size);
+	acct_leave(prevpath);
+	return adat;
+}
+
+/*
+ * propagate the received DBUS signal to afb listeners
+ * returns 0 so that sd-bus also dispatches it to the other matching watches
+ */
+static int on_signal(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+{
+	struct watch *watch = userdata;
+	struct instance *inst = watch->inst;
+	struct sigmemo *sigmemo = &inst->sigmemo;
+	struct dbus_subs_evlist *evlist;
+	afb_data_t adat;
+	uint64_t cookie = 0, start = monotonic_nsec();
+
+	__atomic_add_fetch(&watch->received, 1, __ATOMIC_RELAXED);
+	sd_bus_message_get_cookie(msg, &cookie);
+
+	/* the workers convert and push the events */
+	if (inst->nworkers > 0) {
+		sigtask_add(inst, watch, msg, cookie, start);
+		stall_check(inst, start, "signal", sd_bus_message_get_member(msg));
+		return 0;
+	}
+
+	/* convert the message only once for all the watches it matches with the same selection */
+	if (msg != sigmemo->msg || cookie != sigmemo->cookie) {
+		top_hit(&inst->top_signals, 3, (const char*[]){ sd_bus_message_get_sender(msg),
+				sd_bus_message_get_interface(msg), sd_bus_message_get_member(msg) });
+		get_stamps(start, &sigmemo->stamps);
+	}
+	if (msg != sigmemo->msg || cookie != sigmemo->cookie || !same_select(watch, sigmemo->watch)) {
+		sigmemo_clear(sigmemo);
+		sigmemo->data = make_signal_data(watch, msg, &sigmemo->stamps);
+		sigmemo->msg = sd_bus_message_ref(msg);
+		sigmemo->cookie = cookie;
+		sigmemo->watch = watch;
+		watch->refcount++;
+		if (inst->sigmemo_release != NULL
+		 || sd_event_add_defer(inst->sdevlp, &inst->sigmemo_release, on_sigmemo_release, inst) >= 0)
+			sd_event_source_set_enabled(inst->sigmemo_release, SD_EVENT_ONESHOT);
+	}
+	adat = sigmemo->data;
+
+	/* shed the signal exceeding the limits */
+	if (adat == NULL) {
+		signal_shed(inst, msg);
+		stall_check(inst, start, "signal", sd_bus_message_get_member(msg));
+		return 0;
+	}
+
+	/* send the event now */
+	evlist = watch->subs.evlist;
+	while (evlist != NULL) {
+		afb_data_addref(adat);
+		afb_event_push(((struct evrec*)evlist->evrec)->event, 1, &adat);
+		__atomic_add_fetch(&watch->pushed, 1, __ATOMIC_RELAXED);
+		histogram_add(&watch->dispatch_to_push, monotonic_nsec() - sigmemo->stamps.monotonic * 1000);
+		top_hit(&inst->top_events, 1, (const char*[]){ evlist->evrec->name });
+		evlist = evlist->next;
+	}
+	stall_check(inst, start, "signal", sd_bus_message_get_member(msg));
+	return 0;
+}
+
+/* release the record of the event */
+static void release_evrec(void *closure, struct dbus_subs_evrec *subs)
+{
+	struct instance *inst = closure;
+	struct evrec *evrec = (struct evrec*)subs;
+
+	if (evrec->stream != NULL) {
+		pthread_mutex_lock(&inst->poollock);
+		sigstream_unref(evrec->stream);
+		pthread_mutex_unlock(&inst->poollock);
+	}
+	afb_event_unref(evrec->event);
+	free(evrec);
+}
+
+/* add the DBUS match of the watch, also retrying a match not restored after a reconnection */
+static int start_watch(void *closure, struct dbus_subs_watch *subs)
+{
+	struct instance *inst = closure;
+	struct watch *watch = (struct watch*)subs;
+	struct sd_bus *bus;
+
+	if (watch->slot != NULL)
+		return 0;
+	bus = getbus(inst, subs->busname);
+	if (bus == NULL)
+		return -ENOTCONN;
+	return sd_bus_add_match_async(bus, &watch->slot, subs->match, on_signal, NULL, watch);
+}
+
+/* release the watch */
+static void release_watch(void *closure, struct dbus_subs_watch *subs)
+{
+	struct watch *watch = (struct watch*)subs;
+
+	sd_bus_slot_unref(watch->slot);
+	watch_unref(watch);
+}
+
+/* interface of the subscriptions to the instances */
+static const struct dbus_subs_itf subs_itf = {
+	.create_evrec = create_evrec,
+	.release_evrec = release_evrec,
+	.create_watch = create_watch,
+	.start_watch = start_watch,
+	.release_watch = release_watch
+};
+
+/* add a subscription of the event to the match, returns the event or NULL on error */
+static struct evrec *add_sub(struct instance *inst, struct evsigspec *evs)
+{
+	if (getbus(inst, evs->subs.busname) == NULL)
+		return NULL;
+	return (struct evrec*)dbus_subs_add(&inst->subs, &evs->subs);
+}
+
+/* process subscribe and unsubscribe requests */
+static void process_sub(afb_req_t req, int dir)
+{
+	afb_data_t first_arg;
+	struct json_object *obj;
+
+	struct instance *inst = req_instance(req);
+	struct evsigspec evs;
+	struct dbus_subs_watch *watch;
+	struct evrec *evrec;
+	struct dbus_subs_evlist *evlist;
+	int rc;
+
+	/* get the query */
+	rc = afb_req_param_convert(req, 0, AFB_PREDEFINED_TYPE_JSON_C, &first_arg);
+	if (rc < 0)
+		goto bad_request;
+	obj = (struct json_object*)afb_data_ro_pointer(first_arg);
+	if (obj == NULL)
+		goto bad_request;
+
+	/* get parameters */
+	evs.subs.busname = strval(obj, "bus",       NULL);
+	evs.subs.match   = strval(obj, "match",     NULL);
+	evs.subs.event   = strval(obj, "event",     DEFAULT_EVENT_NAME);
+	evs.select       = NULL;
+	json_object_object_get_ex(obj, "select", &evs.select);
+
+	/* check parameters */
+	evs.subs.busname = std_busname(inst, evs.subs.busname);
+	if (evs.subs.busname == NULL || evs.subs.match == NULL || !select_valid(evs.select, true))
+		goto bad_request;
+	evs.subs.select = select_text(evs.select);
+	flight_target(inst, inst->flightcur, evs.subs.busname, evs.subs.event, evs.subs.match);
+
+	if (dir > 0) {
+		/* subscribing */
+		evrec = add_sub(inst, &evs);
+		if (evrec == NULL)
+			goto internal_error;
+		afb_req_subscribe(req, evrec->event);
+	}
+	else {
+		/* unsubscribing */
+		watch = dbus_subs_search_watch(&inst->subs, &evs.subs);
+		evrec = (struct evrec*)dbus_subs_search_evrec(&inst->subs, evs.subs.event);
+		evlist = watch != NULL && evrec != NULL ? dbus_subs_search_evlist(watch, &evrec->subs) : NULL;
+		if (evlist == NULL)
+			goto bad_request;
+
+		afb_req_unsubscribe(req, evrec->event);
+		dbus_subs_remove(&inst->subs, watch, evlist);
+	}
+	afb_req_reply(req, 0, 0, NULL);
+	return;
+
+bad_request:
+	flight_end(inst, inst->flightcur, AFB_ERRNO_INVALID_REQUEST);
+	afb_req_reply(req, AFB_ERRNO_INVALID_REQUEST, 0, NULL);
+	return;
+
+internal_error:
+	flight_end(inst, inst->flightcur, AFB_ERRNO_INTERNAL_ERROR);
+	afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
+}
+
+static void process_subscribe(afb_req_t req)
+{
+	process_sub(req, 1);
+}
+
+static void process_unsubscribe(afb_req_t req)
+{
+	process_sub(req, -1);
+}
+
+/*****************************************************************************************/
+/* NFC reader monitor */
+/*****************************************************************************************/
+
+/* sleep for the given count of milliseconds */
+static void nfc_sleep(unsigned ms)
+{
+	struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000 };
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+}
+
+/* records the name of the connected reader (or NULL) */
+static void nfc_set_reader(const char *reader)
+{
+	char *name = reader == NULL ? NULL : strdup(reader);
+	pthread_mutex_lock(&nfc_mutex);
+	free(nfc_reader);
+	nfc_reader = name;
+	pthread_mutex_unlock(&nfc_mutex);
+}
+
+/* push the name of the reader to the listeners of the NFC event */
+static void nfc_push_reader(const char *reader)
+{
+	afb_data_t data;
+	if (afb_create_data_copy(&data, AFB_PREDEFINED_TYPE_STRINGZ, reader, strlen(reader) + 1) >= 0)
+		afb_event_push(event_nfc, 1, &data);
+}
+
+/* records the JSON description of the card and pushes it to the listeners of the card event */
+static void nfc_set_card(pcscHandleT *handle, bool present)
+{
+	char uid[20];
+	const char *atr;
+	char *text;
+	struct json_object *obj;
+	afb_data_t data;
+
+	/* read the card from the open session */
+	obj = json_object_new_object();
+	json_object_object_add(obj, "present", json_object_new_boolean(present));
+	if (present) {
+		snprintf(uid, sizeof uid, "%016llx", (unsigned long long)pcscGetCardUuid(handle));
+		atr = pcscGetAtrString(handle);
+		json_object_object_add(obj, "uid", json_object_new_string(uid));
+		json_object_object_add(obj, "atr", atr == NULL ? NULL : json_object_new_string(atr));
+	}
+	text = strdup(json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN));
+	json_object_put(obj);
+
+	/* cache it */
+	pthread_mutex_lock(&nfc_mutex);
+	free(nfc_card);
+	nfc_card = text;
+	pthread_mutex_unlock(&nfc_mutex);
+
+	/* send it */
+	if (text != NULL && afb_create_data_copy(&data, AFB_PREDEFINED_TYPE_JSON, text, strlen(text) + 1) >= 0)
+		afb_event_push(event_nfc_card, 1, &data);
+}
+
+/* connects the first reader known by pcscd, returns its handle or NULL */
+static pcscHandleT *nfc_connect(void)
+{
+	pcscHandleT *list, *handle = NULL;
+	ulong count = NFC_MAX_READERS;
+	const char *readers[NFC_MAX_READERS];
+
+	/* the listing context is only used for discovering the reader */
+	list = pcscList(readers, &count);
+	if (list == NULL) {
+		AFB_ERROR("Failed to connect to pcscd");
+		return NULL;
+	}
+	if (count > 0) {
+		handle = pcscConnect(NFC_UID, readers[0]);
+		if (handle == NULL)
+			AFB_ERROR("Failed to connect NFC reader %s", readers[0]);
+		else {
+			AFB_NOTICE("NFC reader %lu found, %s", count, readers[0]);
+			nfc_set_reader(readers[0]);
+			nfc_push_reader(readers[0]);
+		}
+	}
+	pcscDisconnect(list);
+	return handle;
+}
+
+/* NFC thread keeps one pcsc context alive and reconnects it on failure */
+static void *nfc_run(void *arg)
+{
+	pcscHandleT *handle = NULL;
+	bool present = false;
+	int rc;
+
+	for (;;) {
+		if (handle == NULL)
+			handle = nfc_connect();
+		else {
+			rc = pcscReaderCheck(handle, NFC_CHECK_TICKS);
+			if (rc < 0) {
+				AFB_WARNING("NFC reader lost: %s", pcscErrorMsg(handle));
+				pcscDisconnect(handle);
+				handle = NULL;
+				nfc_set_reader(NULL);
+			}
+			/* the card is read once at insertion and then served from the cache */
+			if ((rc > 0) != present) {
+				present = rc > 0;
+				nfc_set_card(handle, present);
+			}
+		}
+		nfc_sleep(handle == NULL ? NFC_CHECK_PERIOD : NFC_CARD_PERIOD);
+	}
+	return NULL;
+}
+
+/* starts the NFC thread if not already done */
+static int nfc_start(void)
+{
+	int rc = 0;
+	pthread_t thread;
+
+	pthread_mutex_lock(&nfc_mutex);
+	if (!nfc_started) {
+		rc = -pthread_create(&thread, NULL, nfc_run, NULL);
+		if (rc == 0) {
+			pthread_detach(thread);
+			nfc_started = true;
+		}
+	}
+	pthread_mutex_unlock(&nfc_mutex);
+	return rc;
+}
+
+/*****************************************************************************************/
+/* manage signals */
+/*****************************************************************************************/
+
+/* process signal requests */
+static void process_signal(afb_req_t req)
+{
+	afb_data_t first_arg;
+	struct json_object *obj;
+	struct json_object *args;
+
+	const char *busname;
+	const char *destination;
+	const char *path;
+	const char *interface;
+	const char *member;
+	const char *signature;
+
+	struct instance *inst = req_instance(req);
+	struct sd_bus_message *msg = NULL;
+	struct sd_bus *bus;
+	uint64_t start, cookie = 0;
+	int rc;
+
+	/* get the query */
+	rc = afb_req_param_convert(req, 0, AFB_PREDEFINED_TYPE_JSON_C, &first_arg);
+	if (rc < 0)
+		goto bad_request;
+	obj = (struct json_object*)afb_data_ro_pointer(first_arg);
+	if (obj == NULL)
+		goto bad_request;
+
+	/* get parameters */
+	args = NULL;
+	json_object_object_get_ex(obj, "data", &args);
+	destination = strval(obj, "destination", NULL);
+	path        = strval(obj, "path",      NULL);
+	interface   = strval(obj, "interface", NULL);
+	member      = strval(obj, "member",    NULL);
+	signature   = strval(obj, "signature", "");
+	busname     = strval(obj, "bus",       NULL);
+
+	/* check parameters */
+	if (path == NULL || member == NULL)
+		goto bad_request;
+	busname = std_busname(inst, busname);
+	if (busname == NULL)
+		goto bad_request;
+	bus = getbus(inst, busname);
+	if (bus == NULL)
+		goto internal_error;
+	flight_target(inst, inst->flightcur, busname, destination, member);
+
+	/* creates the message */
+	start = monotonic_nsec();
+	rc = sd_bus_message_new_signal(bus, &msg, path, interface, member);
+	if (rc < 0)
+		goto internal_error;
+	if (destination != NULL) {
+		rc = sd_bus_message_set_destination(msg, destination);
+		if (rc < 0)
+			goto internal_error;
+	}
+	rc = jsonc2msg(msg, signature, args);
+	if (rc < 0)
+		goto bad_request;
+	flight_stage(inst, inst->flightcur, Stage_Pack, monotonic_nsec() - start);
+
+	/* Send the message */
+	rc = sd_bus_send(bus, msg, &cookie);
+	if (rc < 0)
+		goto internal_error;
+	AFB_API_DEBUG(inst->api, "signal corr=%llu %s.%s cookie=%llu", (unsigned long long)inst->corrcur,
+			interface ?: "", member, (unsigned long long)cookie);
+	flight_cookies(inst, inst->flightcur, cookie, 0);
+	afb_req_reply(req, 0, 0, NULL);
+	goto cleanup;
+
+internal_error:
+	flight_end(inst, inst->flightcur, AFB_ERRNO_INTERNAL_ERROR);
+	afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
+	goto cleanup;
+
+bad_request:
+	flight_end(inst, inst->flightcur, AFB_ERRNO_INVALID_REQUEST);
+	afb_req_reply(req, AFB_ERRNO_INVALID_REQUEST, 0, NULL);
+
+cleanup:
+	sd_bus_message_unref(msg);
+}
+
+/*****************************************************************************************/
+/* warm-start cache of introspection data */
+/*****************************************************************************************/
+
+/* is the result of the member cached? */
+static bool is_warm_cached(const char *interface, const char *member)
+{
+	return interface != NULL
+	    && ((!strcmp(interface, "org.freedesktop.DBus.Introspectable") && !strcmp(member, "Introspect"))
+	     || (!strcmp(interface, "org.freedesktop.DBus.Properties") && !strcmp(member, "GetAll"))
+	     || (!strcmp(interface, "org.freedesktop.DBus.ObjectManager") && !strcmp(member, "GetManagedObjects")));
+}
+
+/* get the id of the bus, prefix of the owners of the cached values */
+static int warm_cache_owner(struct sd_bus *bus, char owner[SD_ID128_STRING_MAX])
+{
+	sd_id128_t id;
+	int rc = sd_bus_get_bus_id(bus, &id);
+	if (rc >= 0)
+		sd_id128_to_string(id, owner);
+	return rc;
+}
+
+/* save the warm-start cache */
+static int on_warm_cache_save(sd_event_source *s, uint64_t usec, void *userdata)
+{
+	int rc = dbus_cache_save(warm_cache_path);
+	if (rc < 0)
+		AFB_ERROR("Can't save warm-start cache %s: %s", warm_cache_path, strerror(-rc));
+	return 0;
+}
+
+/* schedule the saving of the warm-start cache */
+static void warm_cache_schedule_save(struct instance *inst)
+{
+	int enabled;
+	uint64_t now;
+
+	sd_event_now(inst->sdevlp, CLOCK_MONOTONIC, &now);
+	now += WARM_CACHE_SAVE_DELAY * 1000;
+	if (inst->warm_cache_saver == NULL)
+		sd_event_add_time(inst->sdevlp, &inst->warm_cache_saver, CLOCK_MONOTONIC, now, 0, on_warm_cache_save, NULL);
+	else if (sd_event_source_get_enabled(inst->warm_cache_saver, &enabled) >= 0 && enabled == SD_EVENT_OFF) {
+		sd_event_source_set_time(inst->warm_cache_saver, now);
+		sd_event_source_set_enabled(inst->warm_cache_saver, SD_EVENT_ONESHOT);
+	}
+}
+
+/* search the pending call refreshing key */
+static struct cachecall *search_cachecall(struct instance *inst, const char *key)
+{
+	struct cachecall *cachecall = inst->cachecalls;
+	while(cachecall != NULL && strcmp(key, cachecall->key))
+		cachecall = cachecall->next;
+	return cachecall;
+}
+
+/* add the request to the waiters of the call */
+static int add_cachecall_req(struct cachecall *cachecall, afb_req_t req)
+{
+	afb_req_t *reqs = realloc(cachecall->reqs, (1 + cachecall->nreqs) * sizeof *reqs);
+	if (reqs == NULL)
+		return -1;
+	reqs[cachecall->nreqs++] = afb_req_addref(req);
+	cachecall->reqs = reqs;
+	return 0;
+}
+
+/* receives the reply of a call refreshing the cache */
+static int on_warm_cache_reply(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+{
+	struct cachecall *cachecall = userdata;
+	struct json_object *obj = NULL;
+	char owner[SD_ID128_STRING_MAX], *fullowner;
+	afb_data_t data;
+	unsigned idx;
+	int rc;
+	int sts = AFB_ERRNO_GENERIC_FAILURE;
+	const sd_bus_error *err;
+	size_t size = 0;
+
+	call_replied(cachecall->inst, msg);
+
+	/* make the reply and update the cache */
+	err = sd_bus_message_get_error(msg);
+	if (err != NULL) {
+		obj = jsonc_of_dbus_error(err);
+		dbus_cache_drop(cachecall->key);
+		warm_cache_schedule_save(cachecall->inst);
+	}
+	else {
+		rc = timed_msg2jsonc(cachecall->inst, Conv_Reply, msg, NULL, cachecall->flags, &obj, &size);
+		if (rc == -E2BIG) {
+			__atomic_add_fetch(&cachecall->inst->metrics.refused, 1, __ATOMIC_RELAXED);
+			sts = AFB_ERRNO_OUT_OF_MEMORY;
+			obj = jsonc_of_limits_error();
+		}
+		else if (rc < 0)
+			obj = NULL;
+		else {
+			sts = 0;
+			if (warm_cache_owner(sd_bus_message_get_bus(msg), owner) >= 0
+			 && asprintf(&fullowner, "%s/%s", owner, sd_bus_message_get_sender(msg) ?: "") >= 0) {
+				dbus_cache_put(cachecall->key, fullowner, realtime_usec(),
+					json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN));
+				free(fullowner);
+				warm_cache_schedule_save(cachecall->inst);
+			}
+		}
+	}
+
+	/* send the reply to the waiters */
+	data = charged_data(obj, size);
+	for (idx = 0 ; idx < cachecall->nreqs ; idx++) {
+		afb_data_addref(data);
+		afb_req_reply(cachecall->reqs[idx], sts, 1, &data);
+		afb_req_unref(cachecall->reqs[idx]);
+	}
+	afb_data_unref(data);
+	free(cachecall->reqs);
+	removelistitem(cachecall, &cachecall->inst->cachecalls);
+	return 1;
+}
+
+/*
+ * serve the call of msg for req through the warm-start cache, unique being
+ * the current owner of its destination: the cached value of that owner is
+ * replied at once, and refreshed in background when it was not validated recently
+ */
+static int warm_cache_serve(struct instance *inst, afb_req_t req, struct sd_bus *bus, struct sd_bus_message *msg,
+		const char *key, unsigned flags, const char *unique)
+{
+	char busid[SD_ID128_STRING_MAX], *owner, *value;
+	struct cachecall *cachecall;
+	uint64_t stamp;
+	afb_data_t data;
+	int rc;
+
+	/* reply from the cache */
+	rc = warm_cache_owner(bus, busid);
+	if (rc < 0)
+		return rc;
+	if (asprintf(&owner, "%s/%s", busid, unique) < 0)
+		return -1;
+	value = dbus_cache_get(key, owner, &stamp);
+	free(owner);
+	if (value != NULL) {
+		afb_create_data_raw(&data, AFB_PREDEFINED_TYPE_JSON, value, strlen(value) + 1, free, value);
+		afb_req_reply(req, 0, 1, &data);
+		if (stamp >= warm_cache_start && realtime_usec() - stamp < warm_cache_ttl)
+			return 0;
+		req = NULL;
+	}
+
+	/* join or create the call refreshing the value */
+	cachecall = search_cachecall(inst, key);
+	if (cachecall == NULL) {
+		cachecall = calloc(1, sizeof *cachecall + 1 + strlen(key));
+		if (cachecall == NULL)
+			rc = -1;
+		else {
+			strcpy(cachecall->key, key);
+			cachecall->inst = inst;
+			cachecall->flags = flags;
+			rc = sd_bus_call_async(bus, NULL, msg, on_warm_cache_reply, cachecall, -1);
+			if (rc >= 0)
+				call_sent(inst, bus);
+			if (rc < 0)
+				free(cachecall);
+			else {
+				cachecall->next = inst->cachecalls;
+				inst->cachecalls = cachecall;
+			}
+		}
+		if (rc < 0) {
+			/* the request was already served when refreshing fails */
+			if (req == NULL)
+				AFB_WARNING("Can't refresh warm-start cache value %s", key);
+			return req == NULL ? 0 : rc;
+		}
+	}
+	return req == NULL ? 0 : add_cachecall_req(cachecall, req);
+}
+
+/* receive the current owner of the destination of a cached call */
+static int on_warm_cache_owner(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+{
+	struct cacheowner *cacheowner = userdata;
+	const char *unique = "";
+	int rc;
+
+	/* a name without owner matches no cached value */
+	call_replied(cacheowner->inst, msg);
+	if (sd_bus_message_get_error(msg) == NULL && sd_bus_message_read(msg, "s", &unique) <= 0)
+		unique = "";
+	rc = warm_cache_serve(cacheowner->inst, cacheowner->req, sd_bus_message_get_bus(msg),
+			cacheowner->msg, cacheowner->key, cacheowner->flags, unique);
+	if (rc < 0)
+		afb_req_reply(cacheowner->req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
+	afb_req_unref(cacheowner->req);
+	sd_bus_message_unref(cacheowner->msg);
+	free(cacheowner);
+	return 1;
+}
+
+/*
+ * process the call of msg for req through the warm-start cache
+ * the cached values are only valid for the current owner of the destination
+ * so the owner of a well-known name is first asked to the bus
+ */
+static int warm_cache_call(struct instance *inst, afb_req_t req, struct sd_bus *bus, struct sd_bus_message *msg,
+		const char *key, unsigned flags)
+{
+	const char *destination = sd_bus_message_get_destination(msg);
+	struct cacheowner *cacheowner;
+	int rc;
+
+	/* a unique name is its own owner */
+	if (*destination == ':')
+		return warm_cache_serve(inst, req, bus, msg, key, flags, destination);
+
+	cacheowner = malloc(sizeof *cacheowner + 1 + strlen(key));
+	if (cacheowner == NULL)
+		return -1;
+	cacheowner->inst = inst;
+	cacheowner->req = req;
+	cacheowner->msg = msg;
+	cacheowner->flags = flags;
+	strcpy(cacheowner->key, key);
+	rc = sd_bus_call_method_async(bus, NULL, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+			"org.freedesktop.DBus", "GetNameOwner", on_warm_cache_owner, cacheowner, "s", destination);
+	if (rc < 0) {
+		free(cacheowner);
+		return rc;
+	}
+	call_sent(inst, bus);
+	afb_req_addref(req);
+	sd_bus_message_ref(msg);
+	return 0;
+}
+
+/* initialize the warm-start cache from the configuration */
+static int warm_cache_init(struct json_object *config)
+{
+	struct json_object *item;
+	int rc;
+
+	if (!json_object_object_get_ex(config, "warm-cache", &item))
+		return 0;
+	if (!json_object_is_type(item, json_type_string))
+		goto invalid;
+	warm_cache_path = strdup(json_object_get_string(item));
+	if (warm_cache_path == NULL)
+		return -1;
+	if (json_object_object_get_ex(config, "warm-cache-ttl", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) < 0)
+			goto invalid;
+		warm_cache_ttl = (uint64_t)json_object_get_int64(item) * 1000;
+	}
+	warm_cache_start = realtime_usec();
+	rc = dbus_cache_load(warm_cache_path);
+	if (rc >= 0)
+		AFB_NOTICE("%d values loaded from warm-start cache %s", rc, warm_cache_path);
+	else if (rc != -ENOENT)
+		AFB_WARNING("Can't load warm-start cache %s: %s", warm_cache_path, strerror(-rc));
+	return 0;
+
+invalid:
+	AFB_ERROR("invalid warm-start cache configuration");
+	return -1;
+}
+
+/*****************************************************************************************/
+/* manage calls */
+/*****************************************************************************************/
+
+/*
+ * handle the reply
+ */
+static int on_call_reply(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+{
+	struct pendcall *pendcall = userdata;
+	afb_req_t req = pendcall->req;
+	struct instance *inst = req_instance(req);
+	struct json_object *obj = NULL;
+	struct stamps stamps;
+	uint64_t cookie = 0, reply_cookie = 0;
+	afb_data_t data[2];
+	int rc;
+	int sts = AFB_ERRNO_GENERIC_FAILURE;
+	const sd_bus_error *err;
+	uint64_t start = monotonic_nsec();
+	size_t size = 0;
+
+	call_replied(inst, msg);
+	flight_stage(inst, pendcall->ticket, Stage_Roundtrip, start - pendcall->sent);
+	get_stamps(start, &stamps);
+	sd_bus_message_get_cookie(msg, &cookie);
+	sd_bus_message_get_reply_cookie(msg, &reply_cookie);
+	flight_cookies(inst, pendcall->ticket, 0, cookie);
+	AFB_API_DEBUG(inst->api, "reply corr=%llu cookie=%llu to cookie=%llu", (unsigned long long)pendcall->correlation,
+			(unsigned long long)cookie, (unsigned long long)reply_cookie);
+
+	/* make the reply */
+	err = sd_bus_message_get_error(msg);
+	if (err != NULL)
+		obj = jsonc_of_dbus_error(err);
+	else {
+		rc = timed_msg2jsonc(inst, Conv_Reply, msg, pendcall->selector, pendcall->flags, &obj, &size);
+		if (rc == -E2BIG) {
+			__atomic_add_fetch(&inst->metrics.refused, 1, __ATOMIC_RELAXED);
+			AFB_API_NOTICE(inst->api, "reply of %s exceeds the limits of conversion",
+					sd_bus_message_get_sender(msg) ?: "?");
+			sts = AFB_ERRNO_OUT_OF_MEMORY;
+			obj = jsonc_of_limits_error();
+		}
+		else if (rc < 0)
+			obj = NULL;
+		else
+			sts = 0;
+	}
+
+	flight_stage(inst, pendcall->ticket, Stage_Unpack, monotonic_nsec() - start);
+
+	/* send the reply now, with its timestamps and correlation if required */
+	data[0] = charged_data(obj, size);
+	if (!pendcall->timestamps && !pendcall->correlate)
+		afb_req_reply(req, sts, 1, data);
+	else {
+		obj = pendcall->timestamps ? jsonc_of_stamps(&stamps) : json_object_new_object();
+		if (pendcall->correlate) {
+			json_object_object_add(obj, "correlation", json_object_new_int64((int64_t)pendcall->correlation));
+			json_object_object_add(obj, "cookie", json_object_new_int64((int64_t)reply_cookie));
+			json_object_object_add(obj, "reply-cookie", json_object_new_int64((int64_t)cookie));
+		}
+		afb_create_data_raw(&data[1], AFB_PREDEFINED_TYPE_JSON_C, obj, 0, (void*)json_object_put, obj);
+		afb_req_reply(req, sts, 2, data);
+	}
+	afb_req_unref(req);
+	flight_end(inst, pendcall->ticket, sts);
+	jsonc_select_destroy(pendcall->selector);
+	free(pendcall);
+	stall_check(inst, start, "reply", sd_bus_message_get_signature(msg, 1));
+	return 1;
+}
+
+/* process signal requests */
+static void process_call(afb_req_t req)
+{
+	afb_data_t first_arg;
+	struct json_object *obj;
+	struct json_object *args;
+
+	const char *busname;
+	const char *destination;
+	const char *path;
+	const char *interface;
+	const char *member;
+	const char *signature;
+
+	struct instance *inst = req_instance(req);
+	struct sd_bus_message *msg = NULL;
+	struct sd_bus *bus;
+	struct pendcall *pendcall;
+	struct json_object *select = NULL;
+	struct jsonc_select *selector = NULL;
+	struct json_object *item;
+	unsigned envelope;
+	bool data, timestamps = false, correlate = false;
+	unsigned flags = inst->profile;
+	char *key = NULL;
+	uint64_t start, cookie;
+	int rc;
+
+	/* get the query */
+	rc = afb_req_param_convert(req, 0, AFB_PREDEFINED_TYPE_JSON_C, &first_arg);
+	if (rc < 0)
+		goto bad_request;
+	obj = (struct json_object*)afb_data_ro_pointer(first_arg);
+	if (obj == NULL)
+		goto bad_request;
+
+	/* get parameters */
+	args = NULL;
+	json_object_object_get_ex(obj, "data", &args);
+	destination = strval(obj, "destination", NULL);
+	path        = strval(obj, "path",      NULL);
+	interface   = strval(obj, "interface", NULL);
+	member      = strval(obj, "member",    NULL);
+	signature   = strval(obj, "signature", "");
+	busname     = strval(obj, "bus",       NULL);
+	json_object_object_get_ex(obj, "select", &select);
+	if (json_object_object_get_ex(obj, "timestamps", &item)) {
+		if (!json_object_is_type(item, json_type_boolean))
+			goto bad_request;
+		timestamps = json_object_get_boolean(item);
+	}
+	if (json_object_object_get_ex(obj, "correlation", &item)) {
+		if (!json_object_is_type(item, json_type_boolean))
+			goto bad_request;
+		correlate = json_object_get_boolean(item);
+	}
+	if (json_object_object_get_ex(obj, "profile", &item)) {
+		if (!json_object_is_type(item, json_type_string) || profile_of(json_object_get_string(item), &flags) < 0)
+			goto bad_request;
+	}
+
+	/* check parameters */
+	if (path == NULL || member == NULL)
+		goto bad_request;
+	busname = std_busname(inst, busname);
+	if (busname == NULL)
+		goto bad_request;
+	if (select_parse(select, false, &envelope, &data, &selector) < 0)
+		goto bad_request;
+	bus = getbus(inst, busname);
+	if (bus == NULL)
+		goto internal_error;
+	top_hit(&inst->top_calls, 2, (const char*[]){ destination, member });
+	flight_target(inst, inst->flightcur, busname, destination, member);
+
+	/* creates the message */
+	start = monotonic_nsec();
+	rc = sd_bus_message_new_method_call(bus, &msg, destination, path, interface, member);
+	if (rc != 0)
+		goto internal_error;
+	rc = jsonc2msg(msg, signature, args);
+	if (rc < 0)
+		goto bad_request;
+	flight_stage(inst, inst->flightcur, Stage_Pack, monotonic_nsec() - start);
+
+	/* introspection data is served by the warm-start cache */
+	if (warm_cache_path != NULL && destination != NULL && select == NULL && !timestamps && !correlate
+	 && is_warm_cached(interface, member)) {
+		rc = asprintf(&key, "%s%s %s %s %s.%s %s %s", flags & MSG2JSONC_COMPACT ? "compact " : "",
+				busname, destination ?: "", path, interface, member,
+				signature, json_object_to_json_string_ext(args, JSON_C_TO_STRING_PLAIN));
+		if (rc < 0) {
+			key = NULL;
+			goto internal_error;
+		}
+		rc = warm_cache_call(inst, req, bus, msg, key, flags);
+		if (rc < 0)
+			goto internal_error;
+		goto cleanup;
+	}
+
+	/* Send the message */
+	pendcall = malloc(sizeof *pendcall);
+	if (pendcall == NULL)
+		goto internal_error;
+	pendcall->req = afb_req_addref(req);
+	pendcall->sent = monotonic_nsec();
+	pendcall->selector = selector;
+	pendcall->timestamps = timestamps;
+	pendcall->correlation = inst->corrcur;
+	pendcall->correlate = correlate;
+	pendcall->flags = flags;
+	rc = sd_bus_call_async(bus, NULL, msg, on_call_reply, pendcall, -1);
+	if (rc < 0) {
+		afb_req_unref(req);
+		free(pendcall);
+		goto internal_error;
+	}
+	selector = NULL;
+	cookie = 0;
+	sd_bus_message_get_cookie(msg, &cookie);
+	AFB_API_DEBUG(inst->api, "call corr=%llu %s %s.%s cookie=%llu", (unsigned long long)pendcall->correlation,
+			destination ?: "", interface ?: "", member, (unsigned long long)cookie);
+	flight_cookies(inst, inst->flightcur, cookie, 0);
+	pendcall->ticket = flight_take(inst);
+	call_sent(inst, bus);
+	goto cleanup;
+
+internal_error:
+	flight_end(inst, inst->flightcur, AFB_ERRNO_INTERNAL_ERROR);
+	afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
+	goto cleanup;
+
+bad_request:
+	flight_end(inst, inst->flightcur, AFB_ERRNO_INVALID_REQUEST);
+	afb_req_reply(req, AFB_ERRNO_INVALID_REQUEST, 0, NULL);
+
+cleanup:
+	jsonc_select_destroy(selector);
+	free(key);
+	sd_bus_message_unref(msg);
+}
+
+/*****************************************************************************************/
+/* native interface for the bindings of the binder */
+/*****************************************************************************************/
+
+/**
+* structure for native calls and signals
+*/
+struct ncall
+{
+	/** the instance */
+	struct instance *inst;
+	/** name of the bus */
+	const char *busname;
+	/** is it a signal? */
+	bool issignal;
+	/** the message */
+	const char *destination;
+	const char *path;
+	const char *interface;
+	const char *member;
+	/** argument builder */
+	dbus_native_build_cb_t build;
+	/** reply callback */
+	dbus_native_reply_cb_t reply;
+	/** closure of callbacks */
+	void *closure;
+	/** executor of the reply or NULL */
+	const struct dbus_native_executor *executor;
+	/** copy of the executor */
+	struct dbus_native_executor exec;
+	/** timeout of the call */
+	uint64_t timeout;
+	/** flight record of the call */
+	uint64_t ticket;
+	/** correlation id of the call */
+	uint64_t correlation;
+	/** time of sending in nanoseconds */
+	uint64_t sent;
+	/** the strings */
+	char strings[];
+};
+
+/**
+* structure for native subscriptions
+*/
+struct dbus_native_subscription
+{
+	/** release in the DBUS thread */
+	struct trash trash;
+	/** the instance */
+	struct instance *inst;
+	/** reference count, only changed in the DBUS thread */
+	unsigned refcount;
+	/** mutex protecting the callback */
+	pthread_mutex_t mutex;
+	/** is unsubscribed? set under the mutex, read atomically outside of it */
+	bool dead;
+	/** slot of the match */
+	sd_bus_slot *slot;
+	/** link in the list of active subscriptions */
+	struct dbus_native_subscription *next;
+	/** is in the list of active subscriptions? */
+	bool active;
+	/** name of the bus */
+	const char *busname;
+	/** signal callback */
+	dbus_native_signal_cb_t on_signal;
+	/** closure of the callback */
+	void *closure;
+	/** executor of the callback or NULL */
+	const struct dbus_native_executor *executor;
+	/** copy of the executor */
+	struct dbus_native_executor exec;
+	/** the match */
+	char match[];
+};
+
+/**
+* structure for deliveries to executors
+*/
+struct delivery
+{
+	/** release in the DBUS thread */
+	struct trash trash;
+	/** the received message */
+	sd_bus_message *msg;
+	/** status of the call */
+	int status;
+	/** the native call or NULL */
+	struct ncall *ncall;
+	/** the native subscription or NULL */
+	struct dbus_native_subscription *sub;
+};
+
+/* returns the instance of the native interface */
+static struct instance *native_instance(const struct dbus_native_v1 *native)
+{
+	return (struct instance*)((char*)native - offsetof(struct instance, native));
+}
+
+/* is the bus used by an active native subscription? */
+static bool native_uses_bus(struct instance *inst, const char *busname)
+{
+	struct dbus_native_subscription *sub;
+
+	for (sub = inst->nsubs ; sub != NULL ; sub = sub->next)
+		if (!strcmp(sub->busname, busname))
+			return true;
+	return false;
+}
+
+/* drop a reference to the subscription */
+static void native_sub_unref(struct dbus_native_subscription *sub)
+{
+	if (--sub->refcount == 0) {
+		sd_bus_slot_unref(sub->slot);
+		pthread_mutex_destroy(&sub->mutex);
+		free(sub);
+	}
+}
+
+/* release the subscription in the DBUS thread */
+static void native_sub_release(struct trash *trash)
+{
+	struct dbus_native_subscription *sub = (struct dbus_native_subscription*)trash, **prv;
+
+	if (sub->active) {
+		for (prv = &sub->inst->nsubs ; *prv != sub ; prv = &(*prv)->next);
+		*prv = sub->next;
+		sub->active = false;
+	}
+	native_sub_unref(sub);
+}
+
+/* call the callback of the delivery */
+static void native_call_back(struct delivery *dlv)
+{
+	struct dbus_native_subscription *sub = dlv->sub;
+
+	if (sub == NULL)
+		dlv->ncall->reply(dlv->ncall->closure, dlv->status, dlv->msg);
+	else {
+		pthread_mutex_lock(&sub->mutex);
+		if (!sub->dead)
+			sub->on_signal(sub->closure, dlv->msg);
+		pthread_mutex_unlock(&sub->mutex);
+	}
+}
+
+/* release the delivery in the DBUS thread */
+static void native_delivery_release(struct trash *trash)
+{
+	struct delivery *dlv = (struct delivery*)trash;
+
+	sd_bus_message_unref(dlv->msg);
+	if (dlv->sub != NULL)
+		native_sub_unref(dlv->sub);
+	free(dlv->ncall);
+	free(dlv);
+}
+
+/* job of the executor */
+static void native_delivery_job(void *arg)
+{
+	struct delivery *dlv = arg;
+	struct instance *inst = dlv->sub != NULL ? dlv->sub->inst : dlv->ncall->inst;
+
+	native_call_back(dlv);
+	/* the message is only handled by the DBUS thread */
+	post_trash(inst, &dlv->trash);
+}
+
+/* deliver the message, directly or through the executor */
+static void native_deliver(const struct dbus_native_executor *executor,
+		struct ncall *ncall, struct dbus_native_subscription *sub, int status, sd_bus_message *msg)
+{
+	struct delivery dlv = { .msg = msg, .status = status, .ncall = ncall, .sub = sub }, *pdlv;
+	int rc;
+
+	if (executor != NULL) {
+		pdlv = malloc(sizeof *pdlv);
+		if (pdlv != NULL) {
+			*pdlv = dlv;
+			pdlv->trash.release = native_delivery_release;
+			if (sub == NULL)
+				/* the reply is only dispatched to its call */
+				sd_bus_message_ref(msg);
+			else {
+				/* the signal is also read by the other matches, the executor reads a copy */
+				rc = dbus_copy_signal(msg, &pdlv->msg);
+				if (rc < 0) {
+					AFB_API_ERROR(sub->inst->api, "can't copy the signal %s: %s",
+							sd_bus_message_get_member(msg), strerror(-rc));
+					free(pdlv);
+					return;
+				}
+				sub->refcount++;
+			}
+			executor->queue(executor->closure, native_delivery_job, pdlv);
+			return;
+		}
+	}
+	native_call_back(&dlv);
+	free(ncall);
+}
+
+/* receive the reply of native calls */
+static int on_native_reply(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+{
+	struct ncall *ncall = userdata;
+	struct instance *inst = ncall->inst;
+	uint64_t cookie = 0, reply_cookie = 0, start = monotonic_nsec();
+	char member[256];
+
+	/* the call is released by the delivery */
+	snprintf(member, sizeof member, "%s", ncall->member);
+	call_replied(inst, msg);
+	flight_stage(inst, ncall->ticket, Stage_Roundtrip, start - ncall->sent);
+	sd_bus_message_get_cookie(msg, &cookie);
+	sd_bus_message_get_reply_cookie(msg, &reply_cookie);
+	flight_cookies(inst, ncall->ticket, 0, cookie);
+	AFB_API_DEBUG(inst->api, "native reply corr=%llu cookie=%llu to cookie=%llu", (unsigned long long)ncall->correlation,
+			(unsigned long long)cookie, (unsigned long long)reply_cookie);
+	flight_end(inst, ncall->ticket, sd_bus_message_is_method_error(msg, NULL) ? AFB_ERRNO_GENERIC_FAILURE : 0);
+	native_deliver(ncall->executor, ncall, NULL, 0, msg);
+	stall_check(inst, start, "native reply", member);
+	return 1;
+}
+
+/*
+ * receive the signals of native subscriptions
+ * returns 0 so that sd-bus also dispatches it to the other matches
+ */
+static int on_native_signal(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+{
+	struct dbus_native_subscription *sub = userdata;
+	struct instance *inst = sub->inst;
+	uint64_t start = monotonic_nsec();
+
+	if (!__atomic_load_n(&sub->dead, __ATOMIC_ACQUIRE))
+		native_deliver(sub->executor, NULL, sub, 0, msg);
+	stall_check(inst, start, "native signal", sd_bus_message_get_member(msg));
+	return 0;
+}
+
+/* process native calls and signals in the DBUS thread */
+static void process_native_call(void *closure)
+{
+	struct ncall *ncall = closure;
+	struct instance *inst = ncall->inst;
+	struct sd_bus_message *msg = NULL;
+	struct sd_bus *bus;
+	uint64_t cookie = 0, start = monotonic_nsec();
+	int rc, status = AFB_ERRNO_INTERNAL_ERROR;
+
+	/* creates the message */
+	flight_target(ncall->inst, ncall->inst->flightcur, ncall->busname, ncall->destination, ncall->member);
+	bus = getbus(ncall->inst, ncall->busname);
+	if (bus == NULL)
+		rc = -ENOTCONN;
+	else if (ncall->issignal) {
+		rc = sd_bus_message_new_signal(bus, &msg, ncall->path, ncall->interface, ncall->member);
+		if (rc >= 0 && ncall->destination != NULL)
+			rc = sd_bus_message_set_destination(msg, ncall->destination);
+	}
+	else {
+		top_hit(&ncall->inst->top_calls, 2, (const char*[]){ ncall->destination, ncall->member });
+		rc = sd_bus_message_new_method_call(bus, &msg, ncall->destination, ncall->path, ncall->interface, ncall->member);
+	}
+	if (rc >= 0 && ncall->build != NULL) {
+		rc = ncall->build(msg, ncall->closure);
+		if (rc < 0)
+			status = AFB_ERRNO_INVALID_REQUEST;
+	}
+
+	/* send it */
+	if (rc >= 0) {
+		flight_stage(inst, inst->flightcur, Stage_Pack, monotonic_nsec() - start);
+		if (ncall->issignal)
+			rc = sd_bus_send(bus, msg, &cookie);
+		else {
+			ncall->sent = monotonic_nsec();
+			ncall->correlation = inst->corrcur;
+			rc = sd_bus_call_async(bus, NULL, msg, on_native_reply, ncall, ncall->timeout);
+			if (rc >= 0)
+				sd_bus_message_get_cookie(msg, &cookie);
+		}
+		if (rc >= 0) {
+			AFB_API_DEBUG(inst->api, "native %s corr=%llu %s %s.%s cookie=%llu", ncall->issignal ? "signal" : "call",
+					(unsigned long long)inst->corrcur, ncall->destination ?: "", ncall->interface ?: "",
+					ncall->member, (unsigned long long)cookie);
+			flight_cookies(inst, inst->flightcur, cookie, 0);
+		}
+		if (rc >= 0 && !ncall->issignal) {
+			ncall->ticket = flight_take(inst);
+			call_sent(inst, bus);
+		}
+	}
+	if (rc < 0)
+		flight_end(inst, inst->flightcur, status);
+	sd_bus_message_unref(msg);
+
+	/* terminate */
+	if (ncall->issignal) {
+		if (rc < 0)
+			AFB_API_ERROR(inst->api, "native signal %s failed: %s", ncall->member, strerror(-rc));
+		free(ncall);
+	}
+	else if (rc < 0)
+		native_deliver(ncall->executor, ncall, NULL, rc, NULL);
+}
+
+/* queue a native call or signal */
+static int native_send(const struct dbus_native_v1 *native, bool issignal, const char *bus,
+		const char *destination, const char *path, const char *interface, const char *member,
+		dbus_native_build_cb_t build, dbus_native_reply_cb_t reply, void *closure,
+		const struct dbus_native_executor *executor, uint64_t timeout_usec)
+{
+	struct instance *inst = native_instance(native);
+	struct ncall *ncall;
+	struct job job;
+	char *p;
+	int rc;
+
+	/* check parameters */
+	bus = std_busname(inst, bus);
+	if (bus == NULL || path == NULL || member == NULL || (!issignal && reply == NULL))
+		return -EINVAL;
+
+	/* records the call */
+	ncall = malloc(sizeof *ncall + 4 + strlen(destination ?: "") + strlen(path)
+				+ strlen(interface ?: "") + strlen(member));
+	if (ncall == NULL)
+		return -ENOMEM;
+	ncall->inst = inst;
+	ncall->busname = bus;
+	ncall->issignal = issignal;
+	p = ncall->strings;
+	ncall->destination = destination == NULL ? NULL : p;
+	p = 1 + stpcpy(p, destination ?: "");
+	ncall->path = p;
+	p = 1 + stpcpy(p, path);
+	ncall->interface = interface == NULL ? NULL : p;
+	p = 1 + stpcpy(p, interface ?: "");
+	ncall->member = p;
+	stpcpy(p, member);
+	ncall->build = build;
+	ncall->reply = reply;
+	ncall->closure = closure;
+	ncall->executor = NULL;
+	if (executor != NULL && executor->queue != NULL) {
+		ncall->exec = *executor;
+		ncall->executor = &ncall->exec;
+	}
+	ncall->timeout = timeout_usec;
+
+	/* queue it */
+	job = (struct job){ .proc = process_native_call, .closure = ncall };
+	rc = queue_job(inst, &job);
+	if (rc < 0)
+		free(ncall);
+	return rc;
+}
+
+/* native asynchronous call */
+static int native_call_async(const struct dbus_native_v1 *native, const char *bus,
+		const char *destination, const char *path, const char *interface, const char *member,
+		dbus_native_build_cb_t build, dbus_native_reply_cb_t reply, void *closure,
+		const struct dbus_native_executor *executor, uint64_t timeout_usec)
+{
+	return native_send(native, false, bus, destination, path, interface, member,
+				build, reply, closure, executor, timeout_usec);
+}
+
+/* native signal */
+static int native_signal(const struct dbus_native_v1 *native, const char *bus,
+		const char *destination, const char *path, const char *interface, const char *member,
+		dbus_native_build_cb_t build, void *closure)
+{
+	return native_send(native, true, bus, destination, path, interface, member,
+				build, NULL, closure, NULL, 0);
+}
+
+/* process native subscriptions in the DBUS thread */
+static void process_native_subscribe(void *closure)
+{
+	struct dbus_native_subscription *sub = closure;
+	struct sd_bus *bus;
+	int rc = -ENOTCONN;
+
+	if (!__atomic_load_n(&sub->dead, __ATOMIC_ACQUIRE)) {
+		bus = getbus(sub->inst, sub->busname);
+		if (bus != NULL)
+			rc = sd_bus_add_match_async(bus, &sub->slot, sub->match, on_native_signal, NULL, sub);
+		if (rc < 0)
+			AFB_API_ERROR(sub->inst->api, "native subscription to %s failed: %s", sub->match, strerror(-rc));
+		else {
+			sub->next = sub->inst->nsubs;
+			sub->inst->nsubs = sub;
+			sub->active = true;
+		}
+	}
 }
 
-/* create and add in the list */
-static struct evrec *create_evrec(afb_api_t api, const char *name)
+/* native subscription */
+static int native_subscribe(const struct dbus_native_v1 *native, const char *bus, const char *match,
+		dbus_native_signal_cb_t on_signal, void *closure,
+		const struct dbus_native_executor *executor, struct dbus_native_subscription **subscription)
 {
-	struct evrec *evrec = malloc(sizeof *evrec + 1 + strlen(name));
-	if (evrec != NULL) {
-		int rc = afb_api_new_event(api, name, &evrec->event);
-		if (rc < 0) {
-			free(evrec);
-			evrec = NULL;
-		}
-		else {
-			strcpy(evrec->name, name);
-			evrec->refcnt = 0;
-			evrec->next = evts;
-			evts = evrec;
-		}
+	struct instance *inst = native_instance(native);
+	struct dbus_native_subscription *sub;
+	pthread_mutexattr_t attr;
+	struct job job;
+	int rc;
+
+	/* check parameters */
+	bus = std_busname(inst, bus);
+	if (bus == NULL || match == NULL || on_signal == NULL)
+		return -EINVAL;
+
+	/* records the subscription */
+	sub = calloc(1, sizeof *sub + 1 + strlen(match));
+	if (sub == NULL)
+		return -ENOMEM;
+	sub->trash.release = native_sub_release;
+	sub->inst = inst;
+	sub->refcount = 1;
+	sub->busname = bus;
+	sub->on_signal = on_signal;
+	sub->closure = closure;
+	if (executor != NULL && executor->queue != NULL) {
+		sub->exec = *executor;
+		sub->executor = &sub->exec;
+	}
+	strcpy(sub->match, match);
+	/* the callback can unsubscribe */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&sub->mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	/* queue it */
+	job = (struct job){ .proc = process_native_subscribe, .closure = sub };
+	rc = queue_job(inst, &job);
+	if (rc < 0) {
+		pthread_mutex_destroy(&sub->mutex);
+		free(sub);
+		return rc;
 	}
-	return evrec;
+	*subscription = sub;
+	return 0;
 }
 
-/* remove from the list */
-static void remove_evrec(struct evrec *evrec)
+/* native unsubscription */
+static void native_unsubscribe(const struct dbus_native_v1 *native, struct dbus_native_subscription *sub)
 {
-	removelistitem(evrec, &evts);
+	pthread_mutex_lock(&sub->mutex);
+	__atomic_store_n(&sub->dead, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&sub->mutex);
+	post_trash(sub->inst, &sub->trash);
 }
 
+/* the native interface */
+static const struct dbus_native_v1 native_v1 = {
+	.version = DBUS_NATIVE_VERSION,
+	.call_async = native_call_async,
+	.subscribe = native_subscribe,
+	.unsubscribe = native_unsubscribe,
+	.signal = native_signal
+};
+
 /*****************************************************************************************/
-/* manage dbus matchers (watch) */
+/* registry of names and scatter requests */
 /*****************************************************************************************/
 
-/* search in the list */
-static struct watch *search_watch(struct evsigspec *evs)
+/**
+* scatter request: the same call to all the matching names
+*/
+struct scatter
 {
-	struct watch *watch;
-	for (watch = watchers ; watch != NULL ; watch = watch->next) {
-		if (!strcmp(evs->busname, watch->busname) && !strcmp(evs->match, watch->match))
-			break;
-	}
-	return watch;
+	/** link in the list of waiting requests */
+	struct scatter *next;
+	/** the request */
+	afb_req_t req;
+	/** the instance */
+	struct instance *inst;
+	/** the bus */
+	struct sd_bus *bus;
+	/** filters of the names */
+	const char *prefix;
+	const char *pattern;
+	/** the call */
+	const char *path;
+	const char *interface;
+	const char *member;
+	const char *signature;
+	struct json_object *args;
+	/** timeout of the calls in microseconds */
+	uint64_t timeout;
+	/** deadline of the request, monotonic in microseconds */
+	uint64_t deadline;
+	/** timer of the deadline while waiting the names */
+	sd_event_source *timer;
+	/** time of sending in nanoseconds */
+	uint64_t sent;
+	/** flight record */
+	uint64_t ticket;
+	/** correlation id */
+	uint64_t correlation;
+	/** count of pending calls */
+	unsigned pending;
+	/** replies and errors by name */
+	struct json_object *replies;
+	struct json_object *errors;
+	/** estimated size of the replies */
+	size_t size;
+};
+
+/**
+* call of a scatter request to one name
+*/
+struct scatpart
+{
+	/** the scatter request */
+	struct scatter *scatter;
+	/** the called name */
+	char name[];
+};
+
+/* search the name in the registry */
+static struct regname *registry_search(struct registry *reg, const char *name)
+{
+	struct regname *item = reg->names;
+	while (item != NULL && strcmp(name, item->name))
+		item = item->next;
+	return item;
 }
 
-/* create and add in the list */
-static struct watch *create_watch(struct evsigspec *evs)
+/* add the name in the registry */
+static void registry_add(struct registry *reg, const char *name)
 {
-	struct watch *watch;
-	watch = malloc(sizeof *watch + strlen(evs->busname) + strlen(evs->match));
-	if (watch != NULL) {
-		char *p = (char*)&watch[1];
-		watch->busname = p;
-		p = 1 + stpcpy(p, evs->busname);
-		watch->match = p;
-		p = 1 + stpcpy(p, evs->match);
-		watch->evlist = NULL;
-		watch->slot = NULL;
-		watch->next = watchers;
-		watchers = watch;
+	struct regname *item;
+
+	if (registry_search(reg, name) == NULL) {
+		item = malloc(sizeof *item + 1 + strlen(name));
+		if (item != NULL) {
+			strcpy(item->name, name);
+			item->next = reg->names;
+			reg->names = item;
+		}
 	}
-	return watch;
 }
 
-/* remove from the list */
-static void remove_watch(struct watch *watch)
+/* remove the name from the registry */
+static void registry_remove(struct registry *reg, const char *name)
 {
-	removelistitem(watch, &watchers);
+	struct regname *item = registry_search(reg, name);
+	if (item != NULL)
+		removelistitem(item, &reg->names);
 }
 
-/*****************************************************************************************/
-/* manage items linking matches (watch) to events */
-/*****************************************************************************************/
-
-/* search in the list */
-static struct evlist *search_evlist(struct watch *watch, struct evrec *evrec)
+/* reply the error to the scatter request and release it */
+static void scatter_fail(struct scatter *sc, int status)
 {
-	struct evlist *evlist = watch->evlist;
-	while(evlist != NULL && evlist->evrec != evrec)
-		evlist = evlist->next;
-	return evlist;
+	sd_event_source_unref(sc->timer);
+	flight_end(sc->inst, sc->ticket, status);
+	afb_req_reply(sc->req, status, 0, NULL);
+	afb_req_unref(sc->req);
+	free(sc);
 }
 
-/* create and add in the list */
-static struct evlist *create_evlist(struct watch *watch, struct evrec *evrec)
+/* forget the names, fail the waiting requests */
+static void registry_reset(struct registry *reg)
 {
-	struct evlist *evlist = malloc(sizeof *evlist);
-	if (evlist != NULL) {
-		evlist->evrec = evrec;
-		evlist->refcnt = 0;
-		evlist->next = watch->evlist;
-		watch->evlist = evlist;
+	struct scatter *sc;
+
+	sd_bus_slot_unref(reg->match);
+	sd_bus_slot_unref(reg->listing);
+	reg->match = reg->listing = NULL;
+	reg->ready = false;
+	while (reg->names != NULL)
+		removelistitem(reg->names, &reg->names);
+	while ((sc = reg->waiting) != NULL) {
+		reg->waiting = sc->next;
+		scatter_fail(sc, AFB_ERRNO_INTERNAL_ERROR);
 	}
-	return evlist;
 }
 
-/* remove from the list */
-static void remove_evlist(struct watch *watch, struct evlist *evlist)
+/* follow the changes of names */
+static int on_name_owner_changed(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
 {
-	removelistitem(evlist, &watch->evlist);
+	struct registry *reg = userdata;
+	const char *name, *oldowner, *newowner;
+
+	if (sd_bus_message_read(msg, "sss", &name, &oldowner, &newowner) > 0) {
+		if (*newowner)
+			registry_add(reg, name);
+		else
+			registry_remove(reg, name);
+	}
+	/* only observed, the subscriptions also receive it */
+	return 0;
 }
 
-/*****************************************************************************************/
-/* manage subscriptions */
-/*****************************************************************************************/
+static void scatter_fire(struct scatter *sc);
 
-/* propagate the received DBUS signal to afb listeners */
-static int on_signal(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+/* receive the initial list of names */
+static int on_names_listed(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
 {
-	struct watch *watch = userdata;
-	struct evlist *evlist;
-	struct json_object *obj, *data = NULL;
-	afb_data_t adat;
-	int rc = -1;
+	struct registry *reg = userdata;
+	struct scatter *sc;
 	const sd_bus_error *err;
+	const char *name;
+	int rc;
 
-	/* check if error */
-	err = sd_bus_message_get_error(msg);
-	if (err != NULL)
-		data = jsonc_of_dbus_error(err);
-	else
-		rc = msg2jsonc(msg, &data);
+	call_replied(reg->inst, msg);
+	sd_bus_slot_unref(reg->listing);
+	reg->listing = NULL;
 
-	/* make the sent event */
-	obj = json_object_new_object();
-	json_object_object_add(obj, "bus", json_object_new_string(watch->busname));
-	json_object_object_add(obj, "status", json_object_new_string(rc >= 0 ? "success" : "error"));
-	json_object_object_add(obj, "data", data);
-	json_object_object_add(obj, "sender",    json_object_new_string(sd_bus_message_get_sender(msg)));
-	json_object_object_add(obj, "path",      json_object_new_string(sd_bus_message_get_path(msg)));
-	json_object_object_add(obj, "interface", json_object_new_string(sd_bus_message_get_interface(msg)));
-	json_object_object_add(obj, "member",    json_object_new_string(sd_bus_message_get_member(msg)));
+	err = sd_bus_message_get_error(msg);
+	rc = err != NULL ? -1 : sd_bus_message_enter_container(msg, 'a', "s");
+	while (rc > 0 && (rc = sd_bus_message_read_basic(msg, 's', &name)) > 0)
+		registry_add(reg, name);
+	if (rc < 0) {
+		AFB_API_ERROR(reg->inst->api, "can't list the names of the bus: %s",
+				err != NULL ? err->message : strerror(-rc));
+		registry_reset(reg);
+		return 1;
+	}
 
-	/* send the event now */
-	afb_create_data_raw(&adat, AFB_PREDEFINED_TYPE_JSON_C, obj, 0, (void*)json_object_put, obj);
-	evlist = watch->evlist;
-	while (evlist != NULL) {
-		afb_data_addref(adat);
-		afb_event_push(evlist->evrec->event, 1, &adat);
-		evlist = evlist->next;
+	reg->ready = true;
+	while ((sc = reg->waiting) != NULL) {
+		reg->waiting = sc->next;
+		scatter_fire(sc);
 	}
-	afb_data_unref(adat);
 	return 1;
 }
 
-/* process subscribe and unsubscribe requests */
-static void process_sub(afb_req_t req, int dir)
+/* start the registry of names of the bus */
+static int registry_start(struct instance *inst, struct sd_bus *bus)
 {
-	afb_data_t first_arg;
-	struct json_object *obj;
-
-	struct evsigspec evs;
-	struct watch *watch;
-	struct evrec *evrec;
-	struct evlist *evlist;
-
-	struct sd_bus *bus;
+	struct registry *reg = &inst->registries[bus_index(inst, bus)];
 	int rc;
-	int issys, add;
 
-	/* get the query */
-	rc = afb_req_param_convert(req, 0, AFB_PREDEFINED_TYPE_JSON_C, &first_arg);
+	/* follow the changes before listing */
+	reg->inst = inst;
+	rc = sd_bus_match_signal_async(bus, &reg->match, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+			"org.freedesktop.DBus", "NameOwnerChanged", on_name_owner_changed, NULL, reg);
+	if (rc >= 0)
+		rc = sd_bus_call_method_async(bus, &reg->listing, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+			"org.freedesktop.DBus", "ListNames", on_names_listed, reg, NULL);
 	if (rc < 0)
-		goto bad_request;
-	obj = (struct json_object*)afb_data_ro_pointer(first_arg);
-	if (obj == NULL)
-		goto bad_request;
+		registry_reset(reg);
+	else
+		call_sent(inst, bus);
+	return rc;
+}
 
-	/* get parameters */
-	evs.busname     = strval(obj, "bus",       NULL);
-	evs.match       = strval(obj, "match",     NULL);
-	evs.event       = strval(obj, "event",     DEFAULT_EVENT_NAME);
+/* does the name match the filter of the scatter request? */
+static bool scatter_match(struct scatter *sc, const char *name)
+{
+	const char *filter = sc->prefix ?: sc->pattern;
 
-	/* check parameters */
-	evs.busname = std_busname(evs.busname);
-	if (evs.busname == NULL || evs.match == NULL)
-		goto bad_request;
-	bus = getbus(evs.busname);
-	if (bus == NULL)
-		goto internal_error;
+	/* unique names only match filters of unique names */
+	if (name[0] == ':' && filter[0] != ':')
+		return false;
+	return sc->prefix != NULL
+		? !strncmp(name, sc->prefix, strlen(sc->prefix))
+		: !fnmatch(sc->pattern, name, 0);
+}
 
-	/* search the watcher and the event */
-	watch = search_watch(&evs);
-	evrec = search_evrec(evs.event);
+/* reply the gathered results of the scatter request */
+static void scatter_done(struct scatter *sc)
+{
+	struct json_object *obj;
+	afb_data_t data;
 
-	if (dir > 0) {
-		/* subscribing */
-		if (evrec == NULL)
-			evrec = create_evrec(afb_req_get_api(req), evs.event);
-		if (watch == NULL)
-			watch = create_watch(&evs);
-		if (watch == NULL || evrec == NULL)
-			goto internal_error;
+	flight_stage(sc->inst, sc->ticket, Stage_Roundtrip, monotonic_nsec() - sc->sent);
+	flight_end(sc->inst, sc->ticket, 0);
+	obj = json_object_new_object();
+	json_object_object_add(obj, "replies", sc->replies);
+	json_object_object_add(obj, "errors", sc->errors);
+	data = charged_data(obj, sc->size);
+	afb_req_reply(sc->req, 0, 1, &data);
+	afb_req_unref(sc->req);
+	free(sc);
+}
 
-		evlist = search_evlist(watch, evrec);
-		if (evlist != NULL)
-			evlist->refcnt++;
-		else {
-			/* add the link */
-			evlist = create_evlist(watch, evrec);
-			if (evlist == NULL)
-				goto internal_error;
-			evlist->refcnt++;
-			evrec->refcnt++;
-
-			/* process DBUS subscription */
-			rc = sd_bus_add_match_async(bus, &watch->slot, watch->match,
-					on_signal, NULL, watch);
-			if (rc < 0) {
-				process_sub(req, 0);
-				return;
-			}
-		}
-		afb_req_subscribe(req, evrec->event);
-	}
-	else {
-		/* unsubscribing */
-		evlist = watch != NULL && evrec != NULL ? search_evlist(watch, evrec) : NULL;
-		if (evlist == NULL)
-			goto bad_request;
+/* receive the reply of one of the calls */
+static int on_scatter_reply(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+{
+	struct scatpart *part = userdata;
+	struct scatter *sc = part->scatter;
+	struct json_object *obj;
+	const sd_bus_error *err;
+	uint64_t cookie = 0, reply_cookie = 0;
+	size_t size;
+	int rc;
 
-		afb_req_unsubscribe(req, evrec->event);
-		if (evlist->refcnt > 1)
-			evlist->refcnt--;
-		else {
-			remove_evlist(watch, evlist);
-			if (watch->evlist == NULL) {
-				sd_bus_slot_unref(watch->slot);
-				remove_watch(watch);
-			}
-			if (evrec->refcnt > 1)
-				evrec->refcnt--;
-			else {
-				afb_event_unref(evrec->event);
-				remove_evrec(evrec);
-			}
-		}
+	call_replied(sc->inst, msg);
+	sd_bus_message_get_cookie(msg, &cookie);
+	sd_bus_message_get_reply_cookie(msg, &reply_cookie);
+	AFB_API_DEBUG(sc->inst->api, "scatter reply corr=%llu %s cookie=%llu to cookie=%llu", (unsigned long long)sc->correlation,
+			part->name, (unsigned long long)cookie, (unsigned long long)reply_cookie);
+	err = sd_bus_message_get_error(msg);
+	if (err != NULL)
+		json_object_object_add(sc->errors, part->name, jsonc_of_dbus_error(err));
+	else if ((rc = timed_msg2jsonc(sc->inst, Conv_Reply, msg, NULL, sc->inst->profile, &obj, &size)) >= 0) {
+		json_object_object_add(sc->replies, part->name, obj);
+		sc->size += size;
 	}
-	afb_req_reply(req, 0, 0, NULL);
-	return;
-
-bad_request:
-	if (dir) {
-		afb_req_reply(req, AFB_ERRNO_INVALID_REQUEST, 0, NULL);
-		return;
+	else if (rc == -E2BIG) {
+		__atomic_add_fetch(&sc->inst->metrics.refused, 1, __ATOMIC_RELAXED);
+		json_object_object_add(sc->errors, part->name, jsonc_of_limits_error());
 	}
-internal_error:
-	afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
+	else
+		json_object_object_add(sc->errors, part->name, json_object_new_string("invalid reply"));
+	free(part);
+	if (--sc->pending == 0)
+		scatter_done(sc);
+	return 1;
 }
 
-static void process_subscribe(afb_req_t req)
+/* send the call to all the matching names */
+static void scatter_fire(struct scatter *sc)
 {
-	process_sub(req, 1);
-}
+	struct registry *reg = &sc->inst->registries[bus_index(sc->inst, sc->bus)];
+	struct sd_bus_message *msg;
+	struct scatpart *part;
+	struct regname *item;
+	uint64_t cookie, now;
+	int rc;
 
-static void process_unsubscribe(afb_req_t req)
-{
-	process_sub(req, -1);
+	/* the calls have the time remaining before the deadline */
+	if (sc->timer != NULL) {
+		sd_event_source_unref(sc->timer);
+		sc->timer = NULL;
+		sd_event_now(sc->inst->sdevlp, CLOCK_MONOTONIC, &now);
+		sc->timeout = sc->deadline > now ? sc->deadline - now : 1;
+	}
+	sc->sent = monotonic_nsec();
+	sc->replies = json_object_new_object();
+	sc->errors = json_object_new_object();
+	sc->pending = 1;
+	for (item = reg->names ; item != NULL ; item = item->next) {
+		if (!scatter_match(sc, item->name))
+			continue;
+		top_hit(&sc->inst->top_calls, 2, (const char*[]){ item->name, sc->member });
+		msg = NULL;
+		part = malloc(sizeof *part + 1 + strlen(item->name));
+		rc = part == NULL ? -ENOMEM
+			: sd_bus_message_new_method_call(sc->bus, &msg, item->name, sc->path, sc->interface, sc->member);
+		if (rc >= 0)
+			rc = jsonc2msg(msg, sc->signature, sc->args);
+		if (rc >= 0) {
+			part->scatter = sc;
+			strcpy(part->name, item->name);
+			rc = sd_bus_call_async(sc->bus, NULL, msg, on_scatter_reply, part, sc->timeout);
+		}
+		if (rc >= 0) {
+			/* the record keeps the cookie of the first call */
+			cookie = 0;
+			sd_bus_message_get_cookie(msg, &cookie);
+			AFB_API_DEBUG(sc->inst->api, "scatter corr=%llu %s %s.%s cookie=%llu", (unsigned long long)sc->correlation,
+					item->name, sc->interface ?: "", sc->member, (unsigned long long)cookie);
+			if (sc->pending == 1)
+				flight_cookies(sc->inst, sc->ticket, cookie, 0);
+		}
+		sd_bus_message_unref(msg);
+		if (rc < 0) {
+			free(part);
+			json_object_object_add(sc->errors, item->name, json_object_new_string(strerror(-rc)));
+		}
+		else {
+			call_sent(sc->inst, sc->bus);
+			sc->pending++;
+		}
+	}
+	if (--sc->pending == 0)
+		scatter_done(sc);
 }
 
-static void check_nfc_cb(afb_timer_t timer, void *closure, unsigned decount)
+/* the deadline of a scatter request expired before the names were listed */
+static int on_scatter_deadline(sd_event_source *s, uint64_t usec, void *userdata)
 {
-	bool nfc_state = false;
-	afb_data_t ev_data;
-	// from the pcsd library
-	pcscHandleT *handle;
-	ulong readerCount = 2;
-    const char *readerList[readerCount];
-
-	// AFB_NOTICE("Check nfc...");
-
-	handle=pcscList(readerList, &readerCount);
-
-	if(!handle)
-		AFB_ERROR("Failed to connect to pcscd");
-	else
-	{
-		nfc_state=true;
-
-		if(readerCount)
-		{
-			afb_create_data_copy(&ev_data, AFB_PREDEFINED_TYPE_STRINGZ, readerList[0], strlen(readerList[0]) + 1);
-			afb_event_push(event_nfc, 1, &ev_data);
-			afb_timer_unref(timer);
-		}
-		
-		AFB_NOTICE("NFC reader %lu found, %s",readerCount,readerList[0]);
-	}
+	struct scatter *sc = userdata;
+	struct registry *reg = &sc->inst->registries[bus_index(sc->inst, sc->bus)];
 
+	unlinklistitem(sc, &reg->waiting);
+	scatter_fail(sc, AFB_ERRNO_GENERIC_FAILURE);
+	return 0;
 }
 
-/*****************************************************************************************/
-/* manage signals */
-/*****************************************************************************************/
-
-/* process signal requests */
-static void process_signal(afb_req_t req)
+/* process scatter requests */
+static void process_scatter(afb_req_t req)
 {
 	afb_data_t first_arg;
-	struct json_object *obj;
-	struct json_object *args;
-
+	struct json_object *obj, *item;
+	struct instance *inst = req_instance(req);
+	struct registry *reg;
+	struct scatter *sc;
 	const char *busname;
-	const char *destination;
-	const char *path;
-	const char *interface;
-	const char *member;
-	const char *signature;
-
-	struct sd_bus_message *msg = NULL;
-	struct sd_bus *bus;
-	int rc;
+	uint64_t now;
+	int rc, timeout;
 
 	/* get the query */
 	rc = afb_req_param_convert(req, 0, AFB_PREDEFINED_TYPE_JSON_C, &first_arg);
@@ -635,166 +3719,309 @@ static void process_signal(afb_req_t req)
 	obj = (struct json_object*)afb_data_ro_pointer(first_arg);
 	if (obj == NULL)
 		goto bad_request;
+	sc = calloc(1, sizeof *sc);
+	if (sc == NULL)
+		goto internal_error;
 
-	/* get parameters */
-	args = NULL;
-	json_object_object_get_ex(obj, "data", &args);
-	destination = strval(obj, "destination", NULL);
-	path        = strval(obj, "path",      NULL);
-	interface   = strval(obj, "interface", NULL);
-	member      = strval(obj, "member",    NULL);
-	signature   = strval(obj, "signature", "");
-	busname     = strval(obj, "bus",       NULL);
+	/* get parameters, valid as long as the request */
+	json_object_object_get_ex(obj, "data", &sc->args);
+	sc->prefix    = strval(obj, "prefix",    NULL);
+	sc->pattern   = strval(obj, "pattern",   NULL);
+	sc->path      = strval(obj, "path",      NULL);
+	sc->interface = strval(obj, "interface", NULL);
+	sc->member    = strval(obj, "member",    NULL);
+	sc->signature = strval(obj, "signature", "");
+	busname       = strval(obj, "bus",       NULL);
+	timeout = SCATTER_TIMEOUT;
+	if (json_object_object_get_ex(obj, "timeout", &item))
+		timeout = json_object_is_type(item, json_type_int) ? json_object_get_int(item) : -1;
 
 	/* check parameters */
-	if (path == NULL || member == NULL)
-		goto bad_request;
-	busname = std_busname(busname);
-	if (busname == NULL)
+	busname = std_busname(inst, busname);
+	if (sc->path == NULL || sc->member == NULL || (sc->prefix == NULL) == (sc->pattern == NULL)
+	 || busname == NULL || is_scoped_busname(busname) || timeout <= 0) {
+		free(sc);
 		goto bad_request;
-	bus = getbus(busname);
-	if (bus == NULL)
-		goto internal_error;
-	if (bus == NULL)
-		goto internal_error;
-
-	/* creates the message */
-	rc = sd_bus_message_new_signal(bus, &msg, path, interface, member);
-	if (rc < 0)
-		goto internal_error;
-	if (destination != NULL) {
-		rc = sd_bus_message_set_destination(msg, destination);
-		if (rc < 0)
-			goto internal_error;
 	}
-	rc = jsonc2msg(msg, signature, args);
-	if (rc < 0)
-		goto bad_request;
-
-	/* Send the message */
-	rc = sd_bus_send(bus, msg, NULL);
-	if (rc < 0)
+	flight_target(inst, inst->flightcur, busname, sc->prefix ?: sc->pattern, sc->member);
+	sc->bus = getbus(inst, busname);
+	if (sc->bus == NULL) {
+		free(sc);
 		goto internal_error;
-	afb_req_reply(req, 0, 0, NULL);
-	goto cleanup;
+	}
+	sc->timeout = (uint64_t)timeout * 1000;
+	sc->inst = inst;
+	sc->correlation = inst->corrcur;
+	sc->req = afb_req_addref(req);
+	sc->ticket = flight_take(inst);
 
-internal_error:
-	afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
-	goto cleanup;
+	/* fire now or when the names are known, within the deadline */
+	reg = &inst->registries[bus_index(inst, sc->bus)];
+	if (reg->ready)
+		scatter_fire(sc);
+	else {
+		sd_event_now(inst->sdevlp, CLOCK_MONOTONIC, &now);
+		sc->deadline = now + sc->timeout;
+		rc = sd_event_add_time(inst->sdevlp, &sc->timer, CLOCK_MONOTONIC, sc->deadline, 0, on_scatter_deadline, sc);
+		if (rc < 0) {
+			scatter_fail(sc, AFB_ERRNO_INTERNAL_ERROR);
+			return;
+		}
+		sc->next = reg->waiting;
+		reg->waiting = sc;
+		if (reg->listing == NULL)
+			registry_start(inst, sc->bus);
+	}
+	return;
 
 bad_request:
+	flight_end(inst, inst->flightcur, AFB_ERRNO_INVALID_REQUEST);
 	afb_req_reply(req, AFB_ERRNO_INVALID_REQUEST, 0, NULL);
+	return;
 
-cleanup:
-	sd_bus_message_unref(msg);
+internal_error:
+	flight_end(inst, inst->flightcur, AFB_ERRNO_INTERNAL_ERROR);
+	afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
 }
 
 /*****************************************************************************************/
-/* manage calls */
+/* lost connections */
 /*****************************************************************************************/
 
 /*
- * handle the reply
+ * add again to the new connection the matches of the bus,
+ * including the ones whose previous restoration failed
  */
-static int on_call_reply(sd_bus_message *msg, void *userdata, sd_bus_error *ret_error)
+static void rematch(struct instance *inst, const char *busname, struct sd_bus *bus)
 {
-	afb_req_t req = userdata;
-	struct json_object *obj = NULL;
-	afb_data_t data;
+	struct watch *watch;
+	struct dbus_native_subscription *sub;
 	int rc;
-	int sts = AFB_ERRNO_GENERIC_FAILURE;
-	const sd_bus_error *err;
 
-	/* make the reply */
-	err = sd_bus_message_get_error(msg);
-	if (err != NULL)
-		obj = jsonc_of_dbus_error(err);
-	else {
-		rc = msg2jsonc(msg, &obj);
-		if (rc < 0)
-			obj = NULL;
+	/* the names are listed again when needed */
+	if (!is_scoped_busname(busname))
+		registry_reset(&inst->registries[bus_index(inst, bus)]);
+
+	for (watch = (struct watch*)inst->subs.watchers ; watch != NULL ; watch = (struct watch*)watch->subs.next) {
+		if (!strcmp(watch->subs.busname, busname)) {
+			sd_bus_slot_unref(watch->slot);
+			watch->slot = NULL;
+			rc = sd_bus_add_match_async(bus, &watch->slot, watch->subs.match, on_signal, NULL, watch);
+			if (rc < 0)
+				AFB_API_ERROR(inst->api, "can't restore match %s: %s", watch->subs.match, strerror(-rc));
+		}
+	}
+	for (sub = inst->nsubs ; sub != NULL ; sub = sub->next) {
+		if (!strcmp(sub->busname, busname)) {
+			sd_bus_slot_unref(sub->slot);
+			sub->slot = NULL;
+			rc = sd_bus_add_match_async(bus, &sub->slot, sub->match, on_native_signal, NULL, sub);
+			if (rc < 0)
+				AFB_API_ERROR(inst->api, "can't restore match %s: %s", sub->match, strerror(-rc));
+		}
+	}
+}
+
+/*****************************************************************************************/
+/* metrics */
+/*****************************************************************************************/
+
+/* writes the label value escaped as required by OpenMetrics */
+static void metrics_label(FILE *out, const char *value)
+{
+	for ( ; *value ; value++) {
+		switch (*value) {
+		case '\\': fputs("\\\\", out); break;
+		case '"': fputs("\\\"", out); break;
+		case '\n': fputs("\\n", out); break;
+		default: fputc(*value, out); break;
+		}
+	}
+}
+
+/* writes the histogram of durations, labels being already formatted */
+static void metrics_histogram(FILE *out, const char *name, const char *labels, struct histogram *histo)
+{
+	uint64_t cumul = 0;
+	unsigned idx;
+
+	for (idx = 0 ; idx <= NHISTOBUCKETS ; idx++) {
+		cumul += __atomic_load_n(&histo->counts[idx], __ATOMIC_RELAXED);
+		if (idx < NHISTOBUCKETS)
+			fprintf(out, "%s_bucket{%s,le=\"%g\"} %llu\n",
+				name, labels, histo_buckets[idx] * 1e-6, (unsigned long long)cumul);
 		else
-			sts = 0;
+			fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %llu\n",
+				name, labels, (unsigned long long)cumul);
 	}
+	fprintf(out, "%s_sum{%s} %.9f\n%s_count{%s} %llu\n",
+		name, labels, __atomic_load_n(&histo->sum, __ATOMIC_RELAXED) * 1e-9,
+		name, labels, (unsigned long long)cumul);
+}
 
-	/* send the reply now */
-	afb_create_data_raw(&data, AFB_PREDEFINED_TYPE_JSON_C, obj, 0, (void*)json_object_put, obj);
-	afb_req_reply(req, sts, 1, &data);
-	afb_req_unref(req);
-	return 1;
+/* writes the family of the counter of the watches at offset, the lock of the watches being held */
+static void metrics_watch_counter(FILE *out, struct instance *inst, const char *name, const char *help, size_t offset)
+{
+	const char *api = afb_api_name(inst->api);
+	struct watch *watch;
+
+	fprintf(out, "# TYPE %s counter\n# HELP %s %s\n", name, name, help);
+	for (watch = (struct watch*)inst->subs.watchers ; watch != NULL ; watch = (struct watch*)watch->subs.next) {
+		fprintf(out, "%s_total{api=\"%s\",bus=\"%s\",match=\"", name, api, watch->subs.busname);
+		metrics_label(out, watch->subs.match);
+		fputs("\",select=\"", out);
+		metrics_label(out, watch->subs.select);
+		fprintf(out, "\"} %llu\n", (unsigned long long)__atomic_load_n(
+				(uint64_t*)((char*)watch + offset), __ATOMIC_RELAXED));
+	}
 }
 
-/* process signal requests */
-static void process_call(afb_req_t req)
+/* writes the metrics of the instance in OpenMetrics text format */
+static void metrics_write(FILE *out, struct instance *inst)
 {
-	afb_data_t first_arg;
-	struct json_object *obj;
-	struct json_object *args;
+	static const char *convnames[Conv_Kind_Count] = { "signal", "reply" };
+	const char *api = afb_api_name(inst->api);
+	struct watch *watch;
+	char labels[256], *wlabels;
+	size_t wsize;
+	FILE *lab;
+	int kind, index;
 
-	const char *busname;
-	const char *destination;
-	const char *path;
-	const char *interface;
-	const char *member;
-	const char *signature;
+	fprintf(out, "# TYPE dbus_queue_depth gauge\n"
+		"# HELP dbus_queue_depth Jobs waiting for the DBUS thread.\n"
+		"dbus_queue_depth{api=\"%s\"} %d\n",
+		api, dbus_queue_depth(&inst->queue));
 
-	struct sd_bus_message *msg = NULL;
-	struct sd_bus *bus;
-	int rc;
+	fprintf(out, "# TYPE dbus_calls_in_flight gauge\n"
+		"# HELP dbus_calls_in_flight Calls waiting their reply.\n");
+	for (index = 0 ; index < 2 ; index++)
+		fprintf(out, "dbus_calls_in_flight{api=\"%s\",bus=\"%s\"} %lld\n", api, busnames[index],
+			(long long)__atomic_load_n(&inst->metrics.inflight[index], __ATOMIC_RELAXED));
 
-	/* get the query */
-	rc = afb_req_param_convert(req, 0, AFB_PREDEFINED_TYPE_JSON_C, &first_arg);
-	if (rc < 0)
-		goto bad_request;
-	obj = (struct json_object*)afb_data_ro_pointer(first_arg);
-	if (obj == NULL)
-		goto bad_request;
+	fprintf(out, "# TYPE dbus_bus_reconnects counter\n"
+		"# HELP dbus_bus_reconnects Reconnections to the bus after a lost connection.\n");
+	for (index = 0 ; index < 2 ; index++)
+		fprintf(out, "dbus_bus_reconnects_total{api=\"%s\",bus=\"%s\"} %llu\n", api, busnames[index],
+			(unsigned long long)__atomic_load_n(&inst->metrics.reconnects[index], __ATOMIC_RELAXED));
 
-	/* get parameters */
-	args = NULL;
-	json_object_object_get_ex(obj, "data", &args);
-	destination = strval(obj, "destination", NULL);
-	path        = strval(obj, "path",      NULL);
-	interface   = strval(obj, "interface", NULL);
-	member      = strval(obj, "member",    NULL);
-	signature   = strval(obj, "signature", "");
-	busname     = strval(obj, "bus",       NULL);
+	fprintf(out, "# TYPE dbus_conversion_seconds histogram\n"
+		"# HELP dbus_conversion_seconds Duration of conversions of messages to JSON.\n");
+	for (kind = 0 ; kind < Conv_Kind_Count ; kind++) {
+		snprintf(labels, sizeof labels, "api=\"%s\",kind=\"%s\"", api, convnames[kind]);
+		metrics_histogram(out, "dbus_conversion_seconds", labels, &inst->metrics.conversions[kind]);
+	}
 
-	/* check parameters */
-	if (path == NULL || member == NULL)
-		goto bad_request;
-	busname = std_busname(busname);
-	if (busname == NULL)
-		goto bad_request;
-	bus = getbus(busname);
-	if (bus == NULL)
-		goto internal_error;
-	if (bus == NULL)
-		goto internal_error;
+	fprintf(out, "# TYPE dbus_loop_lag_seconds histogram\n"
+		"# HELP dbus_loop_lag_seconds Delay of the periodic probes of the DBUS thread.\n");
+	snprintf(labels, sizeof labels, "api=\"%s\"", api);
+	metrics_histogram(out, "dbus_loop_lag_seconds", labels, &inst->metrics.lag);
 
-	/* creates the message */
-	rc = sd_bus_message_new_method_call(bus, &msg, destination, path, interface, member);
-	if (rc != 0)
-		goto internal_error;
-	rc = jsonc2msg(msg, signature, args);
-	if (rc < 0)
-		goto bad_request;
+	fprintf(out, "# TYPE dbus_loop_stalls counter\n"
+		"# HELP dbus_loop_stalls Callbacks of the DBUS thread running too long.\n"
+		"dbus_loop_stalls_total{api=\"%s\"} %llu\n",
+		api, (unsigned long long)__atomic_load_n(&inst->metrics.stalls, __ATOMIC_RELAXED));
 
-	/* Send the message */
-	rc = sd_bus_call_async(bus, NULL, msg, on_call_reply, afb_req_addref(req), -1);
-	if (rc < 0)
-		goto internal_error;
-	goto cleanup;
+	fprintf(out, "# TYPE dbus_signals_shed counter\n"
+		"# HELP dbus_signals_shed Signals dropped for exceeding the limits of conversion.\n"
+		"dbus_signals_shed_total{api=\"%s\"} %llu\n",
+		api, (unsigned long long)__atomic_load_n(&inst->metrics.shed, __ATOMIC_RELAXED));
 
-internal_error:
-	afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
-	goto cleanup;
+	fprintf(out, "# TYPE dbus_replies_refused counter\n"
+		"# HELP dbus_replies_refused Replies refused for exceeding the limits of conversion.\n"
+		"dbus_replies_refused_total{api=\"%s\"} %llu\n",
+		api, (unsigned long long)__atomic_load_n(&inst->metrics.refused, __ATOMIC_RELAXED));
 
-bad_request:
-	afb_req_reply(req, AFB_ERRNO_INVALID_REQUEST, 0, NULL);
+	fprintf(out, "# TYPE dbus_bus_cached_connections gauge\n"
+		"# HELP dbus_bus_cached_connections Open connections to the buses of users and machines.\n"
+		"dbus_bus_cached_connections{api=\"%s\"} %u\n",
+		api, __atomic_load_n(&inst->nbusconns, __ATOMIC_RELAXED));
 
-cleanup:
-	sd_bus_message_unref(msg);
+	fprintf(out, "# TYPE dbus_bus_evictions counter\n"
+		"# HELP dbus_bus_evictions Idle or least recently used cached connections closed.\n"
+		"dbus_bus_evictions_total{api=\"%s\"} %llu\n",
+		api, (unsigned long long)__atomic_load_n(&inst->metrics.evictions, __ATOMIC_RELAXED));
+
+	fprintf(out, "# TYPE dbus_bus_cached_reconnects counter\n"
+		"# HELP dbus_bus_cached_reconnects Reconnections of cached connections after a lost connection.\n"
+		"dbus_bus_cached_reconnects_total{api=\"%s\"} %llu\n",
+		api, (unsigned long long)__atomic_load_n(&inst->metrics.cached_reconnects, __ATOMIC_RELAXED));
+
+	fprintf(out, "# TYPE dbus_memory_used_bytes gauge\n"
+		"# HELP dbus_memory_used_bytes Estimated size of the converted payloads in flight.\n"
+		"dbus_memory_used_bytes %zu\n",
+		__atomic_load_n(&memory_used, __ATOMIC_RELAXED));
+
+	/* the list of watches only changes when subscribing, each family is written at once */
+	pthread_mutex_lock(&inst->watchlock);
+	metrics_watch_counter(out, inst, "dbus_signals_received", "Signals received per match.",
+			offsetof(struct watch, received));
+	metrics_watch_counter(out, inst, "dbus_signals_converted", "Signals converted to JSON per match.",
+			offsetof(struct watch, converted));
+	metrics_watch_counter(out, inst, "dbus_signals_pushed", "Events pushed per match.",
+			offsetof(struct watch, pushed));
+	fprintf(out, "# TYPE dbus_signal_dispatch_to_push_seconds histogram\n"
+		"# HELP dbus_signal_dispatch_to_push_seconds Delay from the dispatch of signals to the push of their events per match.\n");
+	for (watch = (struct watch*)inst->subs.watchers ; watch != NULL ; watch = (struct watch*)watch->subs.next) {
+		lab = open_memstream(&wlabels, &wsize);
+		if (lab == NULL)
+			break;
+		fprintf(lab, "api=\"%s\",bus=\"%s\",match=\"", api, watch->subs.busname);
+		metrics_label(lab, watch->subs.match);
+		fputs("\",select=\"", lab);
+		metrics_label(lab, watch->subs.select);
+		fputc('"', lab);
+		fclose(lab);
+		metrics_histogram(out, "dbus_signal_dispatch_to_push_seconds", wlabels, &watch->dispatch_to_push);
+		free(wlabels);
+	}
+	pthread_mutex_unlock(&inst->watchlock);
+}
+
+/*****************************************************************************************/
+/* top talkers */
+/*****************************************************************************************/
+
+/* get the ranking of the top as an array of objects whose key parts are named */
+static struct json_object *top_ranking(struct dbus_top *top, uint64_t now, unsigned nnames, const char *names[])
+{
+	struct dbus_top_rank ranks[DBUS_TOP_SIZE];
+	struct json_object *array, *item;
+	const char *part;
+	unsigned count, idx, inam, pos;
+
+	array = json_object_new_array();
+	count = dbus_top_rank(top, now, ranks);
+	for (idx = 0 ; idx < count ; idx++) {
+		item = json_object_new_object();
+		for (pos = inam = 0 ; inam < nnames && pos < ranks[idx].entry->length ; inam++) {
+			part = &ranks[idx].entry->key[pos];
+			json_object_object_add(item, names[inam], json_object_new_string(part));
+			pos += (unsigned)strlen(part) + 1;
+		}
+		json_object_object_add(item, "rate", json_object_new_double(ranks[idx].rate));
+		json_object_object_add(item, "error", json_object_new_double(ranks[idx].error));
+		json_object_array_add(array, item);
+	}
+	return array;
+}
+
+/* reply the top talkers, in the DBUS thread that maintains them */
+static void process_top(afb_req_t req)
+{
+	struct instance *inst = req_instance(req);
+	uint64_t now = monotonic_nsec();
+	struct json_object *obj;
+	afb_data_t data;
+
+	obj = json_object_new_object();
+	json_object_object_add(obj, "signals", top_ranking(&inst->top_signals, now,
+			3, (const char*[]){ "sender", "interface", "member" }));
+	json_object_object_add(obj, "calls", top_ranking(&inst->top_calls, now,
+			2, (const char*[]){ "destination", "member" }));
+	json_object_object_add(obj, "events", top_ranking(&inst->top_events, now,
+			1, (const char*[]){ "event" }));
+	afb_create_data_raw(&data, AFB_PREDEFINED_TYPE_JSON_C, obj, 0, (void*)json_object_put, obj);
+	afb_req_reply(req, 0, 1, &data);
 }
 
 /*****************************************************************************************/
@@ -803,43 +4030,229 @@ cleanup:
 
 static void v_call(afb_req_t req, unsigned narg, const afb_data_t args[])
 {
-	submit(req, process_call);
+	submit(req, process_call, Acct_Call);
 }
 
 static void v_signal(afb_req_t req, unsigned narg, const afb_data_t args[])
 {
-	submit(req, process_signal);
+	submit(req, process_signal, Acct_Signal);
 }
 
 static void v_subscribe(afb_req_t req, unsigned narg, const afb_data_t args[])
 {
-	submit(req, process_subscribe);
+	submit(req, process_subscribe, Acct_Subscribe);
 }
 
 static void v_unsubscribe(afb_req_t req, unsigned narg, const afb_data_t args[])
 {
-	submit(req, process_unsubscribe);
+	submit(req, process_unsubscribe, Acct_Unsubscribe);
 }
 
 static void v_nfc_check(afb_req_t req, unsigned narg, const afb_data_t args[])
 {
-	afb_timer_t timer_nfc_check;
-
-	int location_timer;
+	char *reader;
 
 	afb_req_subscribe(req, event_nfc);
 
-	// every 5 seconds, an event is sent to the listeners (e.g. display-binding)
-	location_timer = afb_timer_create(&timer_nfc_check, 0, 0, 0, 0, 5000, 0, check_nfc_cb, NULL, 0);
-    
-	if (location_timer < 0)
-    {
-        AFB_NOTICE("Timer launch fail");
-    }
+	// the NFC thread sends events to the listeners (e.g. display-binding)
+	if (nfc_start() < 0) {
+		AFB_ERROR("NFC thread launch fail");
+		afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
+		return;
+	}
+
+	// a reader already connected is sent again for the newcomer
+	pthread_mutex_lock(&nfc_mutex);
+	reader = nfc_reader == NULL ? NULL : strdup(nfc_reader);
+	pthread_mutex_unlock(&nfc_mutex);
+	if (reader != NULL) {
+		nfc_push_reader(reader);
+		free(reader);
+	}
 
 	afb_req_reply(req, 0, 0, NULL);
 }
 
+static void v_nfc_card(afb_req_t req, unsigned narg, const afb_data_t args[])
+{
+	afb_data_t data;
+	int rc;
+
+	afb_req_subscribe(req, event_nfc_card);
+	if (nfc_start() < 0) {
+		AFB_ERROR("NFC thread launch fail");
+		afb_req_reply(req, AFB_ERRNO_INTERNAL_ERROR, 0, NULL);
+		return;
+	}
+
+	// the card is served from the cache of the NFC thread
+	pthread_mutex_lock(&nfc_mutex);
+	rc = nfc_card == NULL ? -1
+		: afb_create_data_copy(&data, AFB_PREDEFINED_TYPE_JSON, nfc_card, strlen(nfc_card) + 1);
+	pthread_mutex_unlock(&nfc_mutex);
+
+	if (rc < 0)
+		afb_req_reply(req, 0, 0, NULL);
+	else
+		afb_req_reply(req, 0, 1, &data);
+}
+
+static void v_native(afb_req_t req, unsigned narg, const afb_data_t args[])
+{
+	afb_data_t data;
+	struct instance *inst = req_instance(req);
+	afb_create_data_raw(&data, native_type, &inst->native, sizeof inst->native, NULL, NULL);
+	afb_req_reply(req, 0, 1, &data);
+}
+
+/* summary of the durations: count, mean and upper bounds of the median and of the 99th percentile */
+static struct json_object *jsonc_of_histogram(struct histogram *histo)
+{
+	static const unsigned percents[] = { 50, 99 };
+	static const char *names[] = { "p50-usec", "p99-usec" };
+	struct json_object *obj = json_object_new_object();
+	uint64_t counts[NHISTOBUCKETS + 1], total = 0, cumul;
+	unsigned idx, ipc;
+
+	for (idx = 0 ; idx <= NHISTOBUCKETS ; idx++)
+		total += counts[idx] = __atomic_load_n(&histo->counts[idx], __ATOMIC_RELAXED);
+	json_object_object_add(obj, "count", json_object_new_int64((int64_t)total));
+	if (total > 0) {
+		json_object_object_add(obj, "mean-usec", json_object_new_int64(
+			(int64_t)(__atomic_load_n(&histo->sum, __ATOMIC_RELAXED) / total / 1000)));
+		for (ipc = 0 ; ipc < sizeof percents / sizeof *percents ; ipc++) {
+			for (idx = 0, cumul = counts[0] ; idx < NHISTOBUCKETS && cumul * 100 < total * percents[ipc] ; )
+				cumul += counts[++idx];
+			json_object_object_add(obj, names[ipc], idx < NHISTOBUCKETS
+				? json_object_new_int64((int64_t)histo_buckets[idx]) : NULL);
+		}
+	}
+	return obj;
+}
+
+static void v_stats(afb_req_t req, unsigned narg, const afb_data_t args[])
+{
+	static const char *names[] = { ALLOC_ACCT_PATH_NAMES };
+	struct instance *inst = req_instance(req);
+	struct alloc_acct_counts counts;
+	struct json_object *obj, *alloc, *item, *watches;
+	struct watch *watch;
+	afb_data_t data;
+	int path;
+
+	obj = json_object_new_object();
+
+	/* allocations per code path */
+	if (acct_snapshot(Acct_Other, &counts) >= 0) {
+		alloc = json_object_new_object();
+		for (path = 0 ; path < Acct_Path_Count ; path++) {
+			acct_snapshot(path, &counts);
+			item = json_object_new_object();
+			json_object_object_add(item, "mallocs", json_object_new_int64((int64_t)counts.mallocs));
+			json_object_object_add(item, "frees", json_object_new_int64((int64_t)counts.frees));
+			json_object_object_add(item, "allocated", json_object_new_int64((int64_t)counts.allocated));
+			json_object_object_add(item, "freed", json_object_new_int64((int64_t)counts.freed));
+			json_object_object_add(alloc, names[path], item);
+		}
+		json_object_object_add(obj, "alloc", alloc);
+	}
+
+	/* signals and their delays per match */
+	watches = json_object_new_array();
+	pthread_mutex_lock(&inst->watchlock);
+	for (watch = (struct watch*)inst->subs.watchers ; watch != NULL ; watch = (struct watch*)watch->subs.next) {
+		item = json_object_new_object();
+		json_object_object_add(item, "bus", json_object_new_string(watch->subs.busname));
+		json_object_object_add(item, "match", json_object_new_string(watch->subs.match));
+		json_object_object_add(item, "select", json_object_new_string(watch->subs.select));
+		json_object_object_add(item, "received",
+			json_object_new_int64((int64_t)__atomic_load_n(&watch->received, __ATOMIC_RELAXED)));
+		json_object_object_add(item, "pushed",
+			json_object_new_int64((int64_t)__atomic_load_n(&watch->pushed, __ATOMIC_RELAXED)));
+		json_object_object_add(item, "dispatch-to-push", jsonc_of_histogram(&watch->dispatch_to_push));
+		json_object_array_add(watches, item);
+	}
+	pthread_mutex_unlock(&inst->watchlock);
+	json_object_object_add(obj, "watches", watches);
+
+	afb_create_data_raw(&data, AFB_PREDEFINED_TYPE_JSON_C, obj, 0, (void*)json_object_put, obj);
+	afb_req_reply(req, 0, 1, &data);
+}
+
+static void v_scatter(afb_req_t req, unsigned narg, const afb_data_t args[])
+{
+	submit(req, process_scatter, Acct_Call);
+}
+
+static void v_flight_recorder(afb_req_t req, unsigned narg, const afb_data_t args[])
+{
+	static const char *stages[Stage_Count] = { "wait", "pack", "roundtrip", "unpack" };
+	struct instance *inst = req_instance(req);
+	struct flight_record *copies;
+	struct json_object *array, *item;
+	afb_data_t data;
+	unsigned idx, count;
+	int stage;
+
+	/* read without disturbing the DBUS thread, even when it is stalled */
+	array = json_object_new_array();
+	if (inst->flight != NULL) {
+		copies = malloc(inst->flightsize * sizeof *copies);
+		if (copies == NULL) {
+			json_object_put(array);
+			afb_req_reply(req, AFB_ERRNO_OUT_OF_MEMORY, 0, NULL);
+			return;
+		}
+		count = flight_snapshot(inst, copies);
+		for (idx = 0 ; idx < count ; idx++) {
+			item = json_object_new_object();
+			json_object_object_add(item, "request", json_object_new_int64((int64_t)copies[idx].ticket));
+			json_object_object_add(item, "correlation", json_object_new_int64((int64_t)copies[idx].correlation));
+			if (copies[idx].cookie != 0)
+				json_object_object_add(item, "cookie", json_object_new_int64((int64_t)copies[idx].cookie));
+			if (copies[idx].reply_cookie != 0)
+				json_object_object_add(item, "reply-cookie", json_object_new_int64((int64_t)copies[idx].reply_cookie));
+			json_object_object_add(item, "verb", json_object_new_string(copies[idx].verb));
+			json_object_object_add(item, "bus", json_object_new_string(copies[idx].bus));
+			json_object_object_add(item, "destination", json_object_new_string(copies[idx].destination));
+			json_object_object_add(item, "member", json_object_new_string(copies[idx].member));
+			for (stage = 0 ; stage < Stage_Count ; stage++)
+				json_object_object_add(item, stages[stage],
+					json_object_new_int64((int64_t)(copies[idx].stages[stage] / 1000)));
+			if (copies[idx].done)
+				json_object_object_add(item, "status", json_object_new_int(copies[idx].status));
+			json_object_array_add(array, item);
+		}
+		free(copies);
+	}
+	afb_create_data_raw(&data, AFB_PREDEFINED_TYPE_JSON_C, array, 0, (void*)json_object_put, array);
+	afb_req_reply(req, 0, 1, &data);
+}
+
+static void v_top(afb_req_t req, unsigned narg, const afb_data_t args[])
+{
+	submit(req, process_top, Acct_Other);
+}
+
+static void v_metrics(afb_req_t req, unsigned narg, const afb_data_t args[])
+{
+	afb_data_t data;
+	char *text = NULL;
+	size_t size = 0;
+	FILE *out;
+
+	out = open_memstream(&text, &size);
+	if (out == NULL) {
+		afb_req_reply(req, AFB_ERRNO_OUT_OF_MEMORY, 0, NULL);
+		return;
+	}
+	metrics_write(out, req_instance(req));
+	fputs("# EOF\n", out);
+	fclose(out);
+	afb_create_data_raw(&data, AFB_PREDEFINED_TYPE_STRINGZ, text, size + 1, free, text);
+	afb_req_reply(req, 0, 1, &data);
+}
+
 static void v_version(afb_req_t req, unsigned narg, const afb_data_t args[])
 {
 	afb_data_t data;
@@ -862,50 +4275,340 @@ static void v_info(afb_req_t req, unsigned narg, const afb_data_t args[])
 	afb_req_reply(req, 0, 1, &repldata);
 }
 
-/* array of the verbs exported to afb-daemon */
+/* array of the verbs exported to afb-daemon, the NFC verbs first */
 static const afb_verb_t verbs[] = {
+  { .verb="subscribe_nfc", .callback=v_nfc_check,   .info="subscribe to the nfc check" },
+  { .verb="nfc_card",      .callback=v_nfc_card,    .info="get and subscribe to the nfc card" },
   { .verb="version",       .callback=v_version,     .info="get cuurent version" },
   { .verb="call",          .callback=v_call,        .info="call to dbus method" },
   { .verb="signal",        .callback=v_signal,      .info="signal to dbus method" },
   { .verb="subscribe",     .callback=v_subscribe,   .info="subscribe to a dbus signal" },
   { .verb="unsubscribe",   .callback=v_unsubscribe, .info="unsubscribe to a dbus signal" },
-  { .verb="subscribe_nfc", .callback=v_nfc_check,   .info="subscribe to the nfc check" },
+  { .verb="native",        .callback=v_native,      .info="get the native interface" },
+  { .verb="stats",         .callback=v_stats,       .info="get statistics" },
+  { .verb="metrics",       .callback=v_metrics,     .info="get the metrics in OpenMetrics text format" },
+  { .verb="scatter",       .callback=v_scatter,     .info="call all the names matching a prefix or a pattern" },
+  { .verb="top",           .callback=v_top,         .info="get the top talkers" },
+  { .verb="flight_recorder", .callback=v_flight_recorder, .info="get the records of the last requests" },
   { .verb="info",          .callback=v_info,        .info="info of all verbs" },
   { .verb=NULL }
 };
 
+/* the verbs of the additional instances */
+static const afb_verb_t *const instance_verbs = &verbs[NFC_VERB_COUNT];
+
 /*****************************************************************************************/
 /* initialisation and declaration */
 /*****************************************************************************************/
 
 /* instanciate the default event */
-static int create_default_event(afb_api_t api)
+static int create_default_event(struct instance *inst)
 {
-	struct evrec *evrec = create_evrec(api, DEFAULT_EVENT_NAME);
+	struct dbus_subs_evrec *evrec = dbus_subs_event(&inst->subs, DEFAULT_EVENT_NAME);
 	if (evrec == NULL)
 		return -1;
 	evrec->refcnt = 1;
 	return 0;
 }
 
+/* read the CPUs of the DBUS thread from the configuration */
+static int get_cpus(struct json_object *config, cpu_set_t *cpus)
+{
+	struct json_object *item, *cpu;
+	size_t idx, count;
+
+	CPU_ZERO(cpus);
+	if (!json_object_object_get_ex(config, "cpus", &item))
+		return 0;
+	if (!json_object_is_type(item, json_type_array))
+		return -1;
+	count = json_object_array_length(item);
+	for (idx = 0 ; idx < count ; idx++) {
+		cpu = json_object_array_get_idx(item, idx);
+		if (!json_object_is_type(cpu, json_type_int)
+		 || json_object_get_int(cpu) < 0 || json_object_get_int(cpu) >= CPU_SETSIZE)
+			return -1;
+		CPU_SET(json_object_get_int(cpu), cpus);
+	}
+	return 0;
+}
+
+/* add the static subscriptions of the configuration */
+static int add_static_subs(struct instance *inst, struct json_object *config)
+{
+	struct json_object *subs, *item;
+	struct evsigspec evs;
+	size_t idx, count;
+
+	if (!json_object_object_get_ex(config, "subscriptions", &subs))
+		return 0;
+	if (!json_object_is_type(subs, json_type_array))
+		return -1;
+	count = json_object_array_length(subs);
+	for (idx = 0 ; idx < count ; idx++) {
+		item = json_object_array_get_idx(subs, idx);
+		evs.subs.busname = std_busname(inst, strval(item, "bus", NULL));
+		evs.subs.match = strval(item, "match", NULL);
+		evs.subs.event = strval(item, "event", DEFAULT_EVENT_NAME);
+		evs.select = NULL;
+		json_object_object_get_ex(item, "select", &evs.select);
+		evs.subs.select = select_text(evs.select);
+		if (evs.subs.busname == NULL || evs.subs.match == NULL || add_sub(inst, &evs) == NULL) {
+			AFB_API_ERROR(inst->api, "invalid static subscription %s", json_object_to_json_string(item));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* start the instance: its queue, its loop, its static subscriptions and its thread */
+static int start_instance(struct instance *inst, afb_api_t api, struct json_object *config)
+{
+	struct json_object *item;
+	pthread_attr_t attr;
+	pthread_t thread;
+	cpu_set_t cpus;
+	int rc, halflife, stall, slow, idle, idx;
+
+	inst->api = api;
+	afb_api_set_userdata(api, inst);
+
+	/* read the configuration */
+	inst->defbus = DEFAULT_BUSNAME;
+	if (json_object_object_get_ex(config, "bus", &item)) {
+		inst->defbus = std_busname(inst, json_object_get_string(item));
+		if (inst->defbus == NULL)
+			goto invalid;
+	}
+	inst->mxnrjob = MXNRJOB;
+	if (json_object_object_get_ex(config, "queue", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int(item) <= 0)
+			goto invalid;
+		inst->mxnrjob = json_object_get_int(item);
+	}
+	if (get_cpus(config, &cpus) < 0)
+		goto invalid;
+	halflife = TOP_HALFLIFE;
+	if (json_object_object_get_ex(config, "top-halflife", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int(item) <= 0)
+			goto invalid;
+		halflife = json_object_get_int(item);
+	}
+	dbus_top_init(&inst->top_signals, (uint64_t)halflife * 1000000000);
+	dbus_top_init(&inst->top_calls, (uint64_t)halflife * 1000000000);
+	dbus_top_init(&inst->top_events, (uint64_t)halflife * 1000000000);
+	stall = STALL_THRESHOLD;
+	if (json_object_object_get_ex(config, "stall-threshold", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int(item) <= 0)
+			goto invalid;
+		stall = json_object_get_int(item);
+	}
+	inst->stall_threshold = (uint64_t)stall * 1000000;
+	inst->flightsize = FLIGHT_SIZE;
+	if (json_object_object_get_ex(config, "flight-recorder", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int(item) < 0)
+			goto invalid;
+		inst->flightsize = (unsigned)json_object_get_int(item);
+	}
+	slow = SLOW_THRESHOLD;
+	if (json_object_object_get_ex(config, "slow-threshold", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int(item) <= 0)
+			goto invalid;
+		slow = json_object_get_int(item);
+	}
+	inst->slow_threshold = (uint64_t)slow * 1000000;
+	inst->max_reply_size = MAX_REPLY_SIZE;
+	if (json_object_object_get_ex(config, "max-reply-size", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) < 0)
+			goto invalid;
+		inst->max_reply_size = (size_t)json_object_get_int64(item);
+	}
+	inst->max_objects = MAX_OBJECTS;
+	if (json_object_object_get_ex(config, "max-objects", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) < 0)
+			goto invalid;
+		inst->max_objects = (size_t)json_object_get_int64(item);
+	}
+	if (json_object_object_get_ex(config, "profile", &item)) {
+		if (!json_object_is_type(item, json_type_string) || profile_of(json_object_get_string(item), &inst->profile) < 0)
+			goto invalid;
+	}
+	inst->busconn_max = BUS_CACHE_SIZE;
+	if (json_object_object_get_ex(config, "bus-cache-size", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int(item) <= 0)
+			goto invalid;
+		inst->busconn_max = (unsigned)json_object_get_int(item);
+	}
+	idle = BUS_IDLE_TIMEOUT;
+	if (json_object_object_get_ex(config, "bus-idle-timeout", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int(item) <= 0)
+			goto invalid;
+		idle = json_object_get_int(item);
+	}
+	inst->busconn_idle = (uint64_t)idle * 1000000;
+	if (json_object_object_get_ex(config, "signal-workers", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int(item) < 0)
+			goto invalid;
+		inst->nworkers = json_object_get_int(item);
+	}
+	if (inst == &main_instance && json_object_object_get_ex(config, "memory-budget", &item)) {
+		if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) < 0)
+			goto invalid;
+		memory_budget = (size_t)json_object_get_int64(item);
+	}
+	if (inst == &main_instance && json_object_object_get_ex(config, "watchdog", &item)) {
+		if (!json_object_is_type(item, json_type_boolean))
+			goto invalid;
+		if (json_object_get_boolean(item) && sd_watchdog_enabled(0, &watchdog_period) > 0)
+			watchdog_period *= 1000;
+		else
+			watchdog_period = 0;
+	}
+
+	/* create the job queue */
+	rc = dbus_queue_init(&inst->queue, inst->mxnrjob, sizeof(struct job));
+	if (rc < 0)
+		return rc;
+
+	/* create the flight recorder */
+	if (inst->flightsize > 0) {
+		inst->flight = calloc(inst->flightsize, sizeof *inst->flight);
+		if (inst->flight == NULL)
+			return -1;
+	}
+
+	/* set the native interface */
+	inst->native = native_v1;
+
+	/* create the subscriptions and the default event */
+	dbus_subs_init(&inst->subs, &subs_itf, inst, &inst->watchlock);
+	rc = create_default_event(inst);
+	if (rc < 0)
+		return rc;
+
+	/* create the loop, woken by the job queue */
+	rc = sd_event_new(&inst->sdevlp);
+	if (rc < 0)
+		return rc;
+	rc = sd_event_add_io(inst->sdevlp, NULL, inst->queue.efd, EPOLLIN, gotjob, inst);
+	if (rc < 0)
+		return rc;
+
+	/* probe the lag of the loop */
+	inst->progress = monotonic_nsec();
+	rc = sd_event_add_time(inst->sdevlp, &inst->lag_probe, CLOCK_MONOTONIC,
+			inst->progress / 1000 + LAG_PERIOD * 1000, 1, on_lag_probe, inst);
+	if (rc < 0)
+		return rc;
+	sd_event_source_set_enabled(inst->lag_probe, SD_EVENT_ON);
+	inst->nextinst = instances;
+	__atomic_store_n(&instances, inst, __ATOMIC_RELEASE);
+
+	/* add the static subscriptions before any signal can be missed */
+	rc = add_static_subs(inst, config);
+	if (rc < 0)
+		return rc;
+
+	/* start the signal workers */
+	for (idx = 0 ; idx < inst->nworkers ; idx++) {
+		rc = -pthread_create(&thread, NULL, sigworker, inst);
+		if (rc < 0)
+			return rc;
+	}
+
+	/* start the thread */
+	pthread_attr_init(&attr);
+	if (CPU_COUNT(&cpus) > 0)
+		pthread_attr_setaffinity_np(&attr, sizeof cpus, &cpus);
+	rc = -pthread_create(&thread, &attr, run, inst);
+	pthread_attr_destroy(&attr);
+	return rc;
+
+invalid:
+	AFB_API_ERROR(api, "invalid configuration %s", json_object_to_json_string(config));
+	return -1;
+}
+
+/* initialisation of the additional instances */
+static int instance_mainctl(afb_api_t api, afb_ctlid_t ctlid, afb_ctlarg_t ctlarg, void *userdata)
+{
+	struct instance *inst = userdata;
+	int rc = 0;
+	switch (ctlid) {
+	case afb_ctlid_Pre_Init:
+		rc = afb_api_set_verbs(api, instance_verbs);
+		if (rc >= 0)
+			rc = start_instance(inst, api, inst->config);
+		break;
+	default:
+		break;
+	}
+	return rc;
+}
+
+/* create the additional instances declared in the configuration */
+static int create_instances(struct json_object *config)
+{
+	struct json_object *apis, *item;
+	struct instance *inst;
+	const char *name;
+	afb_api_t api;
+	size_t idx, count;
+	int rc;
+
+	if (!json_object_object_get_ex(config, "apis", &apis))
+		return 0;
+	if (!json_object_is_type(apis, json_type_array))
+		goto invalid;
+	count = json_object_array_length(apis);
+	for (idx = 0 ; idx < count ; idx++) {
+		item = json_object_array_get_idx(apis, idx);
+		name = strval(item, "api", NULL);
+		if (name == NULL)
+			goto invalid;
+		inst = calloc(1, sizeof *inst);
+		if (inst == NULL)
+			return -1;
+		pthread_mutex_init(&inst->mutex, NULL);
+		pthread_mutex_init(&inst->watchlock, NULL);
+		pthread_mutex_init(&inst->poollock, NULL);
+		pthread_cond_init(&inst->poolcond, NULL);
+		inst->config = item;
+		rc = afb_create_api(&api, name, strval(item, "info", "dbus binding"), 0, instance_mainctl, inst);
+		if (rc < 0) {
+			AFB_ERROR("creation of API %s failed", name);
+			return rc;
+		}
+	}
+	return 0;
+
+invalid:
+	AFB_ERROR("invalid declaration of APIs %s", json_object_to_json_string(apis));
+	return -1;
+}
+
 /* initialisation */
 static int mainctl(afb_api_t api, afb_ctlid_t ctlid, afb_ctlarg_t ctlarg, void *userdata)
 {
 	int rc = 0;
-	pthread_t thread;
 	switch (ctlid) {
 	case afb_ctlid_Pre_Init:
-		/* create the default event */
-		rc = create_default_event(api);
-		/* create the loop signaler */
+		/* declare the type of the native interface */
+		rc = afb_type_register(&native_type, DBUS_NATIVE_TYPE_NAME, 0);
+		/* read the warm-start cache */
 		if (rc >= 0)
-			rc = efd = eventfd(0, 0);
-		/* start the thread */
+			rc = warm_cache_init(ctlarg->pre_init.config);
+		/* start the main instance */
 		if (rc >= 0)
-			rc = pthread_create(&thread, NULL, run, NULL);
+			rc = start_instance(&main_instance, api, ctlarg->pre_init.config);
+		/* create the other instances */
+		if (rc >= 0)
+			rc = create_instances(ctlarg->pre_init.config);
 		break;
 	case afb_ctlid_Init:
 		rc = afb_api_new_event(api, "nfc_device_exists", &event_nfc);
+		if (rc >= 0)
+			rc = afb_api_new_event(api, "nfc_card", &event_nfc_card);
 		break;
 	default:
 		break;
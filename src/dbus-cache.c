@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dbus-cache.h"
+
+/*
+ * magic of the cache files
+ */
+#define MAGIC "DBUSWC01"
+
+/*
+ * alignment of the records in the files
+ */
+#define ALIGN 8
+
+/*
+ * header of the cache files
+ */
+struct header
+{
+	/** the magic */
+	char magic[8];
+	/** count of records */
+	uint32_t count;
+	/** size of the file */
+	uint32_t size;
+};
+
+/*
+ * header of the records of cache files,
+ * it is followed by the zero terminated key, owner and value
+ */
+struct record
+{
+	/** time of the record */
+	uint64_t stamp;
+	/** length of the key */
+	uint32_t keylen;
+	/** length of the owner */
+	uint32_t ownerlen;
+	/** length of the value */
+	uint32_t valuelen;
+	/** length of the full record */
+	uint32_t reclen;
+};
+
+/*
+ * cached entry
+ */
+struct entry
+{
+	/** link to next */
+	struct entry *next;
+	/** time of the entry */
+	uint64_t stamp;
+	/** owner of the entry */
+	const char *owner;
+	/** value of the entry */
+	const char *value;
+	/** is owner and value allocated? (or mapped) */
+	int allocated;
+	/** the key */
+	char key[];
+};
+
+/** mutex of the cache */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** mutex serializing the saves, held from the creation of the temporary file to its renaming */
+static pthread_mutex_t savemutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** list of the entries */
+static struct entry *entries = NULL;
+
+/** are there changes not saved? */
+static int dirty = 0;
+
+/* length of the record for the given lengths, computed in 64 bits so it can't wrap */
+static uint64_t reclen(uint64_t keylen, uint64_t ownerlen, uint64_t valuelen)
+{
+	uint64_t len = sizeof(struct record) + keylen + ownerlen + valuelen + 3;
+	return (len + ALIGN - 1) & ~(uint64_t)(ALIGN - 1);
+}
+
+/* search the entry of key and returns the pointer to its link */
+static struct entry **search(const char *key)
+{
+	struct entry **prv = &entries;
+	while (*prv != NULL && strcmp(key, (*prv)->key))
+		prv = &(*prv)->next;
+	return prv;
+}
+
+/* free the entry */
+static void destroy(struct entry *entry)
+{
+	if (entry->allocated) {
+		free((void*)entry->owner);
+		free((void*)entry->value);
+	}
+	free(entry);
+}
+
+/* create an entry, the strings owner and value are not copied */
+static struct entry *create(const char *key, const char *owner, uint64_t stamp, const char *value, int allocated)
+{
+	struct entry *entry = malloc(sizeof *entry + 1 + strlen(key));
+	if (entry != NULL) {
+		strcpy(entry->key, key);
+		entry->owner = owner;
+		entry->value = value;
+		entry->stamp = stamp;
+		entry->allocated = allocated;
+		entry->next = entries;
+		entries = entry;
+	}
+	return entry;
+}
+
+/*
+ * Load the cache file of path
+ * The values of the file stay mapped in memory and are served from there.
+ * Returns the count of loaded entries or a negative error code
+ */
+int dbus_cache_load(const char *path)
+{
+	int fd, count;
+	struct stat st;
+	const struct header *hdr;
+	const struct record *rec;
+	const char *base, *key, *owner, *value;
+	uint32_t idx, off;
+
+	/* map the file */
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof *hdr || st.st_size > (off_t)UINT32_MAX) {
+		close(fd);
+		return -EINVAL;
+	}
+	base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -errno;
+
+	/* check the header */
+	hdr = (const struct header*)base;
+	if (memcmp(hdr->magic, MAGIC, sizeof hdr->magic) || hdr->size != (uint32_t)st.st_size) {
+		munmap((void*)base, (size_t)st.st_size);
+		return -EINVAL;
+	}
+
+	/* read the records */
+	pthread_mutex_lock(&mutex);
+	count = 0;
+	off = (uint32_t)sizeof *hdr;
+	for (idx = 0 ; idx < hdr->count ; idx++) {
+		rec = (const struct record*)&base[off];
+		if (hdr->size - off < (uint32_t)sizeof *rec
+		 || reclen(rec->keylen, rec->ownerlen, rec->valuelen) > hdr->size - off
+		 || rec->reclen != reclen(rec->keylen, rec->ownerlen, rec->valuelen))
+			break;
+		key = (const char*)&rec[1];
+		owner = &key[rec->keylen + 1];
+		value = &owner[rec->ownerlen + 1];
+		if (key[rec->keylen] || owner[rec->ownerlen] || value[rec->valuelen])
+			break;
+		if (*search(key) == NULL && create(key, owner, rec->stamp, value, 0) != NULL)
+			count++;
+		off += rec->reclen;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	/* the file stays mapped if used */
+	if (count == 0)
+		munmap((void*)base, (size_t)st.st_size);
+	return count;
+}
+
+/*
+ * Save the cache to the file of path
+ * Concurrent saves are serialized as they share the temporary file.
+ * Returns the count of saved entries or a negative error code
+ */
+int dbus_cache_save(const char *path)
+{
+	int rc, fd;
+	char *tmp;
+	FILE *file;
+	uint64_t size;
+	struct header hdr;
+	struct record rec;
+	struct entry *entry;
+	static const char zeros[ALIGN];
+
+	/* create the temporary file */
+	rc = asprintf(&tmp, "%s.tmp", path);
+	if (rc < 0)
+		return -ENOMEM;
+	pthread_mutex_lock(&savemutex);
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0600);
+	file = fd < 0 ? NULL : fdopen(fd, "w");
+	if (file == NULL) {
+		rc = -errno;
+		if (fd >= 0)
+			close(fd);
+		pthread_mutex_unlock(&savemutex);
+		free(tmp);
+		return rc;
+	}
+
+	/* write the header and the records */
+	pthread_mutex_lock(&mutex);
+	memcpy(hdr.magic, MAGIC, sizeof hdr.magic);
+	hdr.count = 0;
+	size = sizeof hdr;
+	for (entry = entries ; entry != NULL ; entry = entry->next) {
+		hdr.count++;
+		size += reclen(strlen(entry->key), strlen(entry->owner), strlen(entry->value));
+	}
+	/* the header can't describe a larger file */
+	if (size > UINT32_MAX)
+		rc = -EFBIG;
+	else {
+		hdr.size = (uint32_t)size;
+		fwrite(&hdr, sizeof hdr, 1, file);
+		for (entry = entries ; entry != NULL ; entry = entry->next) {
+			rec.stamp = entry->stamp;
+			rec.keylen = (uint32_t)strlen(entry->key);
+			rec.ownerlen = (uint32_t)strlen(entry->owner);
+			rec.valuelen = (uint32_t)strlen(entry->value);
+			rec.reclen = (uint32_t)reclen(rec.keylen, rec.ownerlen, rec.valuelen);
+			fwrite(&rec, sizeof rec, 1, file);
+			fwrite(entry->key, 1 + rec.keylen, 1, file);
+			fwrite(entry->owner, 1 + rec.ownerlen, 1, file);
+			fwrite(entry->value, 1 + rec.valuelen, 1, file);
+			fwrite(zeros, rec.reclen - sizeof rec - rec.keylen - rec.ownerlen - rec.valuelen - 3, 1, file);
+		}
+		dirty = 0;
+		rc = (int)hdr.count;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	/* commit the file */
+	if (ferror(file) | fclose(file))
+		rc = -EIO;
+	else if (rc >= 0 && rename(tmp, path) < 0)
+		rc = -errno;
+	if (rc < 0)
+		unlink(tmp);
+	pthread_mutex_unlock(&savemutex);
+	free(tmp);
+	return rc;
+}
+
+/*
+ * Are there changes not saved?
+ */
+int dbus_cache_is_dirty(void)
+{
+	return dirty;
+}
+
+/*
+ * Get a copy of the value cached for key if its owner is owner
+ * An entry of an other owner is dropped.
+ * Returns the copy to be freed or NULL if not found.
+ */
+char *dbus_cache_get(const char *key, const char *owner, uint64_t *stamp)
+{
+	char *result = NULL;
+	struct entry **prv, *entry;
+
+	pthread_mutex_lock(&mutex);
+	prv = search(key);
+	entry = *prv;
+	if (entry != NULL) {
+		if (strcmp(owner, entry->owner)) {
+			*prv = entry->next;
+			destroy(entry);
+			dirty = 1;
+		}
+		else {
+			result = strdup(entry->value);
+			*stamp = entry->stamp;
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+	return result;
+}
+
+/*
+ * Set the value cached for key
+ * Returns 0 on success or a negative error code
+ */
+int dbus_cache_put(const char *key, const char *owner, uint64_t stamp, const char *value)
+{
+	int rc = -ENOMEM;
+	struct entry **prv, *entry;
+	char *own = strdup(owner), *val = strdup(value);
+
+	if (own != NULL && val != NULL) {
+		pthread_mutex_lock(&mutex);
+		prv = search(key);
+		entry = *prv;
+		if (entry != NULL) {
+			*prv = entry->next;
+			destroy(entry);
+		}
+		if (create(key, own, stamp, val, 1) != NULL) {
+			own = val = NULL;
+			rc = 0;
+		}
+		dirty = 1;
+		pthread_mutex_unlock(&mutex);
+	}
+	free(own);
+	free(val);
+	return rc;
+}
+
+/*
+ * Drop the value cached for key
+ */
+void dbus_cache_drop(const char *key)
+{
+	struct entry **prv, *entry;
+
+	pthread_mutex_lock(&mutex);
+	prv = search(key);
+	entry = *prv;
+	if (entry != NULL) {
+		*prv = entry->next;
+		destroy(entry);
+		dirty = 1;
+	}
+	pthread_mutex_unlock(&mutex);
+}
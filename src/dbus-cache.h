@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+extern int dbus_cache_load(const char *path);
+extern int dbus_cache_save(const char *path);
+extern int dbus_cache_is_dirty(void);
+extern char *dbus_cache_get(const char *key, const char *owner, uint64_t *stamp);
+extern int dbus_cache_put(const char *key, const char *owner, uint64_t stamp, const char *value);
+extern void dbus_cache_drop(const char *key);
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+
+#include <systemd/sd-bus.h>
+
+#include "dbus-copy.h"
+
+/* copy the signal msg to a new sealed message, returns 0 or a negative error code */
+int dbus_copy_signal(struct sd_bus_message *msg, struct sd_bus_message **copy)
+{
+	struct sd_bus_message *result = NULL;
+	const char *sender, *destination;
+	uint64_t cookie = 0;
+	int rc;
+
+	rc = sd_bus_message_new_signal(sd_bus_message_get_bus(msg), &result, sd_bus_message_get_path(msg),
+			sd_bus_message_get_interface(msg), sd_bus_message_get_member(msg));
+	if (rc < 0)
+		goto end;
+	sender = sd_bus_message_get_sender(msg);
+	if (sender != NULL && (rc = sd_bus_message_set_sender(result, sender)) < 0)
+		goto end;
+	destination = sd_bus_message_get_destination(msg);
+	if (destination != NULL && (rc = sd_bus_message_set_destination(result, destination)) < 0)
+		goto end;
+	rc = sd_bus_message_rewind(msg, 1);
+	if (rc < 0)
+		goto end;
+	rc = sd_bus_message_copy(result, msg, 1);
+	if (rc < 0)
+		goto end;
+	sd_bus_message_get_cookie(msg, &cookie);
+	rc = sd_bus_message_seal(result, cookie, 0);
+	if (rc < 0)
+		goto end;
+	rc = sd_bus_message_rewind(result, 1);
+end:
+	if (rc < 0)
+		result = sd_bus_message_unref(result);
+	*copy = result;
+	return rc < 0 ? rc : 0;
+}
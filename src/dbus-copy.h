@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+struct sd_bus_message;
+
+/*
+ * Private copy of a received signal
+ *
+ * The read position of a message is shared by all its readers, so a
+ * signal dispatched by sd-bus to several matches can't be read by another
+ * thread. The copy has the header fields, the cookie and the body of the
+ * signal but not its timestamps and credentials. It is sealed and ready
+ * to be read.
+ */
+extern int dbus_copy_signal(struct sd_bus_message *msg, struct sd_bus_message **copy);
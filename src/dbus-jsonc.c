@@ -17,7 +17,10 @@
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <pthread.h>
 #include <sys/eventfd.h>
 
@@ -26,6 +29,37 @@
 #include <json-c/json.h>
 
 #include "dbus-jsonc.h"
+#include "alloc-acct.h"
+
+/*
+ * maximum nesting of containers, as for D-Bus
+ */
+#define MAX_DEPTH 64
+
+/*
+ * separator of the components of selected paths
+ */
+#define SELECT_SEPARATOR '/'
+
+/*
+ * estimated cost in bytes of a json object, payload of strings excluded
+ */
+#define ITEM_COST 64
+
+/*
+ * node of the tree of selected paths
+ */
+struct jsonc_select
+{
+	/* next sibling */
+	struct jsonc_select *next;
+	/* the selected children or NULL */
+	struct jsonc_select *children;
+	/* is the value selected entirely? */
+	int all;
+	/* name of the node: index or key */
+	char name[];
+};
 
 /*
  * union of possible dbus values
@@ -44,6 +78,93 @@ union any {
 };
 
 
+/*
+ * Powers of ten exactly represented as doubles
+ */
+static const double pow10s[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+/*
+ * Writes in text the double as a decimal with the fewest possible
+ * decimals, up to 9, if that reads back to the same double.
+ * This is the case of most measures. Returns the length of the
+ * text or 0 if not possible.
+ */
+static int fast_double_text(double value, char text[32])
+{
+	int k, len, pos;
+	double mag, m;
+	uint64_t um;
+	char digits[20];
+
+	/* search the count of decimals */
+	mag = value < 0 ? -value : value;
+	for (k = 0 ; ; k++) {
+		if (k == (int)(sizeof pow10s / sizeof *pow10s))
+			return 0;
+		m = mag * pow10s[k] + 0.5;
+		if (!(m < 9007199254740992.0))
+			return 0;
+		um = (uint64_t)m;
+		/* exact integer and power of ten, so the division is rounded as when reading */
+		if ((double)um / pow10s[k] == mag)
+			break;
+	}
+
+	/* digits in reverse order, at least one before the dot */
+	len = 0;
+	do {
+		digits[len++] = (char)('0' + um % 10);
+		um /= 10;
+	} while (um != 0 || len <= k);
+
+	pos = 0;
+	if (value < 0)
+		text[pos++] = '-';
+	while (len > k)
+		text[pos++] = digits[--len];
+	text[pos++] = '.';
+	if (k == 0)
+		text[pos++] = '0';
+	while (len > 0)
+		text[pos++] = digits[--len];
+	text[pos] = 0;
+	return pos;
+}
+
+/*
+ * Creates the json object of a double, the text being the shortest one
+ * that gives back the same double when read
+ */
+static struct json_object *new_double(double value)
+{
+	int prec, len;
+	char text[32];
+
+	/* JSON has no representation for NaN and infinites */
+	if (!isfinite(value))
+		return NULL;
+
+	/* zero keeps its sign */
+	if (value == 0)
+		return json_object_new_double_s(value, signbit(value) ? "-0.0" : "0.0");
+
+	/* avoid the slow printf when possible */
+	if (fast_double_text(value, text))
+		return json_object_new_double_s(value, text);
+
+	/* 17 digits always read back to the same double */
+	for (prec = 15 ; ; prec++) {
+		len = snprintf(text, sizeof text - 2, "%.*g", prec, value);
+		if (prec == 17 || strtod(text, NULL) == value)
+			break;
+	}
+
+	/* keep it a double when read back */
+	if (strspn(text, "-0123456789") == (size_t)len)
+		strcpy(&text[len], ".0");
+	return json_object_new_double_s(value, text);
+}
+
 /*
  * Signature of a json object
  */
@@ -69,214 +190,371 @@ static const char *signature_for_json(struct json_object *obj)
 }
 
 /*
- * Length of a single complete type
+ * Length of a single complete type or -1 if the signature is invalid
+ * or too deep
  */
 static int lentype(const char *signature, int allows_dict, int allows_not_basic)
 {
-	int rc, len;
-	switch(signature[0]) {
-
-	case SD_BUS_TYPE_ARRAY:
-		if (!allows_not_basic)
-			break;
-		rc = lentype(signature + 1, 1, 1);
-		if (rc < 0)
-			break;
-		return 1 + rc;
+	/* kinds of the pending containers */
+	char stack[MAX_DEPTH];
+	int depth = 0, pos = 0, dictpos = 0;
 
-	case SD_BUS_TYPE_STRUCT_BEGIN:
-		if (!allows_not_basic)
+	for (;;) {
+		/* start of a single complete type */
+		switch(signature[pos]) {
+		case SD_BUS_TYPE_ARRAY:
+		case SD_BUS_TYPE_STRUCT_BEGIN:
+		case SD_BUS_TYPE_DICT_ENTRY_BEGIN:
+			if (!allows_not_basic || depth == MAX_DEPTH)
+				return -1;
+			if (signature[pos] == SD_BUS_TYPE_DICT_ENTRY_BEGIN) {
+				if (!allows_dict)
+					return -1;
+				/* the key is basic */
+				allows_not_basic = 0;
+				dictpos = pos;
+			}
+			allows_dict = signature[pos] == SD_BUS_TYPE_ARRAY;
+			stack[depth++] = signature[pos++];
+			continue;
+
+		case '\x0':
+		case SD_BUS_TYPE_STRUCT:
+		case SD_BUS_TYPE_STRUCT_END:
+		case SD_BUS_TYPE_DICT_ENTRY:
+		case SD_BUS_TYPE_DICT_ENTRY_END:
+			return -1;
+
+		default:
+			pos++;
 			break;
-		len = 1;
-		rc = lentype(signature + len, 0, 1);
-		while (rc > 0 && signature[len] != SD_BUS_TYPE_STRUCT_END) {
-			len += rc;
-			rc = lentype(signature + len, 0, 1);
 		}
-		if (rc < 0)
-			break;
-		return 1 + len;
 
-	case SD_BUS_TYPE_DICT_ENTRY_BEGIN:
-		if (!allows_not_basic || !allows_dict)
-			break;
-		rc = lentype(signature + 1, 0, 0);
-		if (rc < 0)
-			break;
-		len = 1 + rc;
-		rc = lentype(signature + len, 0, 1);
-		if (rc < 0 || signature[len + rc] != SD_BUS_TYPE_DICT_ENTRY_END)
+		/* a complete type ends at pos, terminate the containers it completes */
+		for (;;) {
+			if (depth == 0)
+				return pos;
+			switch (stack[depth - 1]) {
+			case SD_BUS_TYPE_ARRAY:
+				depth--;
+				continue;
+			case SD_BUS_TYPE_STRUCT_BEGIN:
+				if (signature[pos] == SD_BUS_TYPE_STRUCT_END) {
+					pos++;
+					depth--;
+					continue;
+				}
+				break;
+			default:
+				/* the key and the value of a dict entry */
+				if (pos == dictpos + 2) {
+					allows_not_basic = 1;
+					break;
+				}
+				if (signature[pos] != SD_BUS_TYPE_DICT_ENTRY_END)
+					return -1;
+				pos++;
+				depth--;
+				continue;
+			}
 			break;
-		return len + rc + 1;
-
-	case '\x0':
-	case SD_BUS_TYPE_STRUCT:
-	case SD_BUS_TYPE_STRUCT_END:
-	case SD_BUS_TYPE_DICT_ENTRY:
-	case SD_BUS_TYPE_DICT_ENTRY_END:
-		break;
-
-	default:
-		return 1;
+		}
+		allows_dict = 0;
 	}
-	return -1;
 }
 
-
 /*
- * Unpack a D-Bus message to a json object
+ * Creates the json object of a basic D-Bus value
  */
-static int unpacksingle(struct sd_bus_message *msg, struct json_object **result)
+static int unpackbasic(struct sd_bus_message *msg, char c, struct json_object **result)
 {
-	char c;
 	int rc;
 	union any any;
-	const char *content;
-	struct json_object *item;
 
 	*result = NULL;
-	rc = sd_bus_message_peek_type(msg, &c, &content);
-	if (rc <= 0)
+	rc = sd_bus_message_read_basic(msg, c, &any);
+	if (rc < 0)
 		return rc;
-
 	switch (c) {
-	case SD_BUS_TYPE_BYTE:
 	case SD_BUS_TYPE_BOOLEAN:
+		*result = json_object_new_boolean(any.i32);
+		break;
+	case SD_BUS_TYPE_BYTE:
+		*result = json_object_new_int(any.u8);
+		break;
 	case SD_BUS_TYPE_INT16:
+		*result = json_object_new_int(any.i16);
+		break;
 	case SD_BUS_TYPE_UINT16:
+		*result = json_object_new_int(any.u16);
+		break;
 	case SD_BUS_TYPE_INT32:
+		*result = json_object_new_int(any.i32);
+		break;
 	case SD_BUS_TYPE_UINT32:
+		*result = json_object_new_int64(any.u32);
+		break;
 	case SD_BUS_TYPE_INT64:
+		*result = json_object_new_int64(any.i64);
+		break;
 	case SD_BUS_TYPE_UINT64:
+		*result = json_object_new_int64((int64_t)any.u64);
+		break;
 	case SD_BUS_TYPE_DOUBLE:
+		*result = new_double(any.dbl);
+		if (*result == NULL)
+			return 1; /* NaN or infinite are null */
+		break;
 	case SD_BUS_TYPE_STRING:
 	case SD_BUS_TYPE_OBJECT_PATH:
 	case SD_BUS_TYPE_SIGNATURE:
-		rc = sd_bus_message_read_basic(msg, c, &any);
-		if (rc < 0)
-			goto error;
-		switch (c) {
-		case SD_BUS_TYPE_BOOLEAN:
-			*result = json_object_new_boolean(any.i32);
-			break;
-		case SD_BUS_TYPE_BYTE:
-			*result = json_object_new_int(any.u8);
-			break;
-		case SD_BUS_TYPE_INT16:
-			*result = json_object_new_int(any.i16);
-			break;
-		case SD_BUS_TYPE_UINT16:
-			*result = json_object_new_int(any.u16);
-			break;
-		case SD_BUS_TYPE_INT32:
-			*result = json_object_new_int(any.i32);
-			break;
-		case SD_BUS_TYPE_UINT32:
-			*result = json_object_new_int64(any.u32);
-			break;
-		case SD_BUS_TYPE_INT64:
-			*result = json_object_new_int64(any.i64);
-			break;
-		case SD_BUS_TYPE_UINT64:
-			*result = json_object_new_int64((int64_t)any.u64);
-			break;
-		case SD_BUS_TYPE_DOUBLE:
-			*result = json_object_new_string(any.cstr);
-			break;
-		case SD_BUS_TYPE_STRING:
-		case SD_BUS_TYPE_OBJECT_PATH:
-		case SD_BUS_TYPE_SIGNATURE:
-			*result = json_object_new_string(any.cstr);
-			break;
-		}
-		return *result == NULL ? -1 : 1;
+		*result = json_object_new_string(any.cstr);
+		break;
+	}
+	return *result == NULL ? -1 : 1;
+}
 
-	case SD_BUS_TYPE_ARRAY:
-	case SD_BUS_TYPE_VARIANT:
-	case SD_BUS_TYPE_STRUCT:
-	case SD_BUS_TYPE_DICT_ENTRY:
-		rc = sd_bus_message_enter_container(msg, c, content);
-		if (rc < 0)
-			goto error;
-		if (c == SD_BUS_TYPE_ARRAY && content[0] == SD_BUS_TYPE_DICT_ENTRY_BEGIN && content[1] == SD_BUS_TYPE_STRING) {
-			*result = json_object_new_object();
-			if (*result == NULL)
-				return -1;
-			for(;;) {
-				rc = sd_bus_message_enter_container(msg, 0, NULL);
-				if (rc < 0)
-					goto error;
-				if (rc == 0)
-					break;
-				rc = sd_bus_message_read_basic(msg, SD_BUS_TYPE_STRING, &any);
-				if (rc < 0)
-					goto error;
-				rc = unpacksingle(msg, &item);
-				if (rc < 0)
-					goto error;
-				json_object_object_add(*result, any.cstr, item);
-				rc = sd_bus_message_exit_container(msg);
-				if (rc < 0)
-					goto error;
-			}
-		} else {
-			rc = msg2jsonc(msg, result);
-			if (rc < 0)
-				goto error;
-		}
-		rc = sd_bus_message_exit_container(msg);
-		if (rc < 0)
-			goto error;
-		return 1;
-	default:
-		goto error;
+/*
+ * Get the child of the selection node for the key or the index
+ */
+static const struct jsonc_select *select_child(const struct jsonc_select *node, const char *key, unsigned index)
+{
+	char name[16];
+
+	if (key == NULL) {
+		snprintf(name, sizeof name, "%u", index);
+		key = name;
 	}
-error:
-	json_object_put(*result);
-	return -1;
+	for (node = node->children ; node != NULL ; node = node->next)
+		if (!strcmp(node->name, key))
+			return node;
+	return NULL;
+}
+
+/*
+ * Charge the item to the estimated size and count of the result
+ * and tells whether it exceeds the limits
+ */
+static int overflow(const struct jsonc_limits *limits, size_t *size, size_t *count, struct json_object *item)
+{
+	*size += ITEM_COST;
+	if (json_object_is_type(item, json_type_string))
+		*size += (size_t)json_object_get_string_len(item);
+	++*count;
+	return limits != NULL
+		&& ((limits->max_size != 0 && *size > limits->max_size)
+		 || (limits->max_count != 0 && *count > limits->max_count));
 }
 
 /*
  * Unpack a D-Bus message to a json object
+ *
+ * Containers are json arrays of their items except arrays of
+ * dict entries whose key is a string that are json objects.
+ * The containers being entered are recorded in an explicit stack.
+ *
+ * When select isn't NULL, only the selected values are converted.
+ * The others are skipped: omitted from objects, null in arrays.
+ * Variants are transparent for the selection.
+ *
+ * When limits isn't NULL, the conversion stops with -E2BIG as soon
+ * as the result exceeds them. The size and count reached are recorded.
+ *
+ * With the flag MSG2JSONC_COMPACT, variants are replaced by their value
+ * and a message of one value is that value instead of an array.
  */
-int msg2jsonc(struct sd_bus_message *msg, struct json_object **result)
+static int unpack(struct sd_bus_message *msg, const struct jsonc_select *select, struct jsonc_limits *limits,
+		unsigned flags, struct json_object **result)
 {
-	int rc;
+	/* the pending containers */
+	struct {
+		/* the json object of the container */
+		struct json_object *obj;
+		/* key of the dict entry being read or NULL */
+		const char *key;
+		/* selection of the container or NULL when entirely selected */
+		const struct jsonc_select *sel;
+		/* index of the next item */
+		unsigned index;
+		/* is it a variant? */
+		int variant;
+		/* is it a variant replaced by its value? */
+		int unwrap;
+	} stack[MAX_DEPTH + 1];
+	int depth = 0, rc, status = -1;
+	char c;
+	const char *content, *key;
+	const struct jsonc_select *sel;
 	struct json_object *item;
+	size_t size = ITEM_COST, count = 1;
 
 	/* allocates the result */
-	*result = json_object_new_array();
-	if (*result == NULL)
+	stack[0].obj = json_object_new_array();
+	if (stack[0].obj == NULL)
 		goto error;
+	stack[0].key = NULL;
+	stack[0].sel = select != NULL && !select->all ? select : NULL;
+	stack[0].index = 0;
+	stack[0].variant = 0;
+	stack[0].unwrap = 0;
 
 	/* read the values */
 	for (;;) {
-		rc = unpacksingle(msg, &item);
+		/* start the dict entries of string dictionnaries */
+		if (stack[depth].key == NULL && !stack[depth].unwrap && json_object_is_type(stack[depth].obj, json_type_object)) {
+			rc = sd_bus_message_enter_container(msg, 0, NULL);
+			if (rc < 0)
+				goto error;
+			if (rc > 0) {
+				rc = sd_bus_message_read_basic(msg, SD_BUS_TYPE_STRING, &key);
+				if (rc < 0)
+					goto error;
+				stack[depth].key = key;
+			}
+		}
+
+		/* get the next item */
+		rc = sd_bus_message_peek_type(msg, &c, &content);
 		if (rc < 0)
 			goto error;
-		if (rc == 0)
-			return 0;
-		json_object_array_add(*result, item);
+		if (rc == 0) {
+			/* end of the container */
+			if (depth == 0) {
+				if (limits != NULL) {
+					limits->size = size;
+					limits->count = count;
+				}
+				item = stack[0].obj;
+				if ((flags & MSG2JSONC_COMPACT) && json_object_array_length(item) == 1) {
+					*result = json_object_get(json_object_array_get_idx(item, 0));
+					json_object_put(item);
+				}
+				else
+					*result = item;
+				return 0;
+			}
+			if (stack[depth].key != NULL)
+				goto error;
+			rc = sd_bus_message_exit_container(msg);
+			if (rc < 0)
+				goto error;
+			item = stack[depth--].obj;
+		}
+		else {
+			/* selection of the item */
+			sel = stack[depth].sel;
+			if (sel != NULL && !stack[depth].variant) {
+				sel = select_child(sel, stack[depth].key, stack[depth].index);
+				if (sel == NULL) {
+					/* not selected */
+					rc = sd_bus_message_skip(msg, NULL);
+					if (rc < 0)
+						goto error;
+					if (stack[depth].key == NULL) {
+						item = NULL;
+						goto add;
+					}
+					stack[depth].key = NULL;
+					rc = sd_bus_message_exit_container(msg);
+					if (rc < 0)
+						goto error;
+					continue;
+				}
+				if (sel->all)
+					sel = NULL;
+			}
+			switch (c) {
+			case SD_BUS_TYPE_ARRAY:
+			case SD_BUS_TYPE_VARIANT:
+			case SD_BUS_TYPE_STRUCT:
+			case SD_BUS_TYPE_DICT_ENTRY:
+				/* enter the container */
+				if (depth == MAX_DEPTH)
+					goto error;
+				rc = sd_bus_message_enter_container(msg, c, content);
+				if (rc < 0)
+					goto error;
+				if (c == SD_BUS_TYPE_VARIANT && (flags & MSG2JSONC_COMPACT)) {
+					/* the value will replace the variant */
+					stack[++depth].obj = NULL;
+					stack[depth].key = NULL;
+					stack[depth].sel = sel;
+					stack[depth].index = 0;
+					stack[depth].variant = 1;
+					stack[depth].unwrap = 1;
+					continue;
+				}
+				if (c == SD_BUS_TYPE_ARRAY
+				 && content[0] == SD_BUS_TYPE_DICT_ENTRY_BEGIN
+				 && content[1] == SD_BUS_TYPE_STRING)
+					item = json_object_new_object();
+				else
+					item = json_object_new_array();
+				if (item == NULL)
+					goto error;
+				if (overflow(limits, &size, &count, item)) {
+					json_object_put(item);
+					goto toobig;
+				}
+				stack[++depth].obj = item;
+				stack[depth].key = NULL;
+				stack[depth].sel = sel;
+				stack[depth].index = 0;
+				stack[depth].variant = c == SD_BUS_TYPE_VARIANT;
+				stack[depth].unwrap = 0;
+				continue;
+			default:
+				rc = unpackbasic(msg, c, &item);
+				if (rc < 0)
+					goto error;
+				if (overflow(limits, &size, &count, item)) {
+					json_object_put(item);
+					goto toobig;
+				}
+				break;
+			}
+		}
+
+		/* add the item to its container */
+add:
+		if (stack[depth].unwrap) {
+			json_object_put(stack[depth].obj);
+			stack[depth].obj = item;
+		}
+		else if (stack[depth].key == NULL) {
+			json_object_array_add(stack[depth].obj, item);
+			stack[depth].index++;
+		}
+		else {
+			json_object_object_add(stack[depth].obj, stack[depth].key, item);
+			stack[depth].key = NULL;
+			rc = sd_bus_message_exit_container(msg);
+			if (rc < 0)
+				goto error;
+		}
 	}
+toobig:
+	status = -E2BIG;
 error:
-	json_object_put(*result);
+	while (depth >= 0)
+		json_object_put(stack[depth--].obj);
+	if (limits != NULL) {
+		limits->size = size;
+		limits->count = count;
+	}
 	*result = NULL;
-	return -1;
+	return status;
 }
 
-static int packsingle(struct sd_bus_message *msg, const char *signature, struct json_object *item)
+/*
+ * Append the basic value of the json item to the message
+ */
+static int packbasic(struct sd_bus_message *msg, char c, struct json_object *item)
 {
-	int index, count, rc, len;
-	char *subsig;
-	struct json_object_iterator it, end;
 	union any any;
 	const void *data = &any;
 
-	len = lentype(signature, 0, 1);
-	if (len < 0)
-		goto error;
-
-	switch (*signature) {
+	switch (c) {
 	case SD_BUS_TYPE_BOOLEAN:
 		any.i32 = json_object_get_boolean(item);
 		break;
@@ -284,35 +562,35 @@ static int packsingle(struct sd_bus_message *msg, const char *signature, struct
 	case SD_BUS_TYPE_BYTE:
 		any.i32 = json_object_get_int(item);
 		if (any.i32 != (int32_t)(uint8_t)any.i32)
-			goto error;
+			return -1;
 		any.u8 = (uint8_t)any.i32;
 		break;
 
 	case SD_BUS_TYPE_INT16:
 		any.i32 = json_object_get_int(item);
 		if (any.i32 != (int32_t)(int16_t)any.i32)
-			goto error;
+			return -1;
 		any.i16 = (int16_t)any.i32;
 		break;
 
 	case SD_BUS_TYPE_UINT16:
 		any.i32 = json_object_get_int(item);
 		if (any.i32 != (int32_t)(uint16_t)any.i32)
-			goto error;
+			return -1;
 		any.u16 = (uint16_t)any.i32;
 		break;
 
 	case SD_BUS_TYPE_INT32:
 		any.i64 = json_object_get_int64(item);
 		if (any.i64 != (int64_t)(int32_t)any.i64)
-			goto error;
+			return -1;
 		any.i32 = (int32_t)any.i64;
 		break;
 
 	case SD_BUS_TYPE_UINT32:
 		any.i64 = json_object_get_int64(item);
 		if (any.i64 != (int64_t)(uint32_t)any.i64)
-			goto error;
+			return -1;
 		any.u32 = (uint32_t)any.i64;
 		break;
 
@@ -334,148 +612,328 @@ static int packsingle(struct sd_bus_message *msg, const char *signature, struct
 		data = any.cstr = json_object_get_string(item);
 		break;
 
-	case SD_BUS_TYPE_VARIANT:
-		signature = signature_for_json(item);
-		if (signature == NULL)
-			goto error;
-		rc = sd_bus_message_open_container(msg, SD_BUS_TYPE_VARIANT, signature);
-		if (rc < 0)
-			goto error;
-		rc = packsingle(msg, signature, item);
-		if (rc < 0)
-			goto error;
-		rc = sd_bus_message_close_container(msg);
-		if (rc < 0)
-			goto error;
-		return len;
+	default:
+		return -1;
+	}
+	return sd_bus_message_append_basic(msg, c, data);
+}
 
-	case SD_BUS_TYPE_ARRAY:
-		subsig = strndupa(signature + 1, len - 1);
-		rc = sd_bus_message_open_container(msg, SD_BUS_TYPE_ARRAY, subsig);
-		if (rc < 0)
-			goto error;
-		if (json_object_is_type(item, json_type_array)) {
-			/* Is an array! */
-			count = (int)json_object_array_length(item);
-			index = 0;
-			while(index < count) {
-				rc = packsingle(msg, subsig, json_object_array_get_idx(item, index++));
-				if (rc < 0)
-					goto error;
-			}
-		} else {
-			/* Not an array! Check if it matches an string dictionnary */
-			if (!json_object_is_type(item, json_type_object))
-				goto error;
-			if (*subsig++ != SD_BUS_TYPE_DICT_ENTRY_BEGIN)
+/*
+ * Open a container whose contents is the signature of length len
+ */
+static int opencontainer(struct sd_bus_message *msg, char type, const char *signature, int len)
+{
+	char contents[256];
+
+	if (len >= (int)sizeof contents)
+		return -1;
+	memcpy(contents, signature, (size_t)len);
+	contents[len] = 0;
+	return sd_bus_message_open_container(msg, type, contents);
+}
+
+/*
+ * kinds of the containers being packed
+ */
+enum packkind {
+	/** sequence of types, the items are in a json array or single */
+	Pack_Sequence,
+	/** array of items of a json array */
+	Pack_Array,
+	/** array of dict entries of a json object */
+	Pack_Dict,
+	/** variant of a single item */
+	Pack_Variant
+};
+
+/*
+ * Pack the json list to the message
+ *
+ * Returns the length of the signature scanned or, on error,
+ * the opposite of one more than the offset of the failing item.
+ * The containers being filled are recorded in an explicit stack.
+ */
+static int pack(struct sd_bus_message *msg, const char *signature, struct json_object *list)
+{
+	/* the pending containers */
+	struct {
+		/* kind of the container */
+		enum packkind kind;
+		/* signature of the sequence or of the items */
+		const char *signature;
+		/* length of the sequence or of the contents of dict entries */
+		int len;
+		/* offsets in the sequence of the current and next items */
+		int scan, next;
+		/* json items, index and count */
+		struct json_object *list;
+		int index, count;
+		/* iteration of dictionnaries */
+		struct json_object_iterator it, end;
+		/* is a dict entry open? */
+		int inentry;
+	} stack[MAX_DEPTH + 1], *top;
+	int depth = 0, rc, len, done;
+	const char *sig;
+	struct json_object *item;
+
+	/* the root sequence */
+	top = &stack[0];
+	top->kind = Pack_Sequence;
+	top->signature = signature;
+	top->len = (int)strlen(signature);
+	top->scan = top->next = 0;
+	top->list = list;
+	top->index = 0;
+	/* not an array is down graded gracefully to single */
+	top->count = list == NULL ? 0 : json_object_is_type(list, json_type_array) ? (int)json_object_array_length(list) : 1;
+
+	for (;;) {
+		/* get the next item of the current container */
+		top = &stack[depth];
+		done = 1;
+		switch (top->kind) {
+		case Pack_Sequence:
+			top->scan = top->next;
+			if (top->index == top->count && top->scan == top->len)
+				break;
+			if (top->index == top->count || top->scan == top->len)
 				goto error;
-			if (*subsig != SD_BUS_TYPE_STRING)
+			sig = &top->signature[top->scan];
+			if (json_object_is_type(top->list, json_type_array))
+				item = json_object_array_get_idx(top->list, (size_t)top->index);
+			else
+				item = top->list;
+			top->index++;
+			if (item == NULL)
 				goto error;
-			/* iterate the object values */
-			subsig[strlen(subsig) - 1] = 0;
-			it = json_object_iter_begin(item);
-			end = json_object_iter_end(item);
-			while (!json_object_iter_equal(&it, &end)) {
-				rc = sd_bus_message_open_container(msg, SD_BUS_TYPE_DICT_ENTRY, subsig);
-				if (rc < 0)
-					goto error;
-				any.cstr = json_object_iter_peek_name(&it);
-				rc = sd_bus_message_append_basic(msg, *subsig, &any);
-				if (rc < 0)
-					goto error;
-				rc = packsingle(msg, subsig + 1, json_object_iter_peek_value(&it));
-				if (rc < 0)
-					goto error;
+			done = 0;
+			break;
+
+		case Pack_Array:
+			if (top->index == top->count)
+				break;
+			sig = top->signature;
+			item = json_object_array_get_idx(top->list, (size_t)top->index++);
+			done = 0;
+			break;
+
+		case Pack_Dict:
+			if (top->inentry) {
 				rc = sd_bus_message_close_container(msg);
 				if (rc < 0)
 					goto error;
-				json_object_iter_next(&it);
+				json_object_iter_next(&top->it);
+				top->inentry = 0;
 			}
+			if (json_object_iter_equal(&top->it, &top->end))
+				break;
+			rc = opencontainer(msg, SD_BUS_TYPE_DICT_ENTRY, top->signature, top->len);
+			if (rc < 0)
+				goto error;
+			top->inentry = 1;
+			rc = sd_bus_message_append_basic(msg, SD_BUS_TYPE_STRING, json_object_iter_peek_name(&top->it));
+			if (rc < 0)
+				goto error;
+			sig = top->signature + 1;
+			item = json_object_iter_peek_value(&top->it);
+			done = 0;
+			break;
+
+		case Pack_Variant:
+			if (top->index == 1)
+				break;
+			top->index = 1;
+			sig = top->signature;
+			item = top->list;
+			done = 0;
+			break;
 		}
-		rc = sd_bus_message_close_container(msg);
-		if (rc < 0)
-			goto error;
-		return len;
-
-	case SD_BUS_TYPE_STRUCT_BEGIN:
-	case SD_BUS_TYPE_DICT_ENTRY_BEGIN:
-		subsig = strndupa(signature + 1, len - 2);
-		rc = sd_bus_message_open_container(msg,
-			((*signature) == SD_BUS_TYPE_STRUCT_BEGIN) ? SD_BUS_TYPE_STRUCT : SD_BUS_TYPE_DICT_ENTRY,
-			subsig);
-		if (rc < 0)
-			goto error;
-		rc = jsonc2msg(msg, subsig, item);
-		if (rc < 0)
-			goto error;
-		rc = sd_bus_message_close_container(msg);
-		if (rc < 0)
+
+		/* end of the container? */
+		if (done) {
+			if (depth == 0)
+				return top->scan;
+			rc = sd_bus_message_close_container(msg);
+			if (rc < 0)
+				goto error;
+			depth--;
+			continue;
+		}
+
+		/* pack the item */
+		len = lentype(sig, 0, 1);
+		if (len < 0)
 			goto error;
-		return len;
+		if (top->kind == Pack_Sequence)
+			top->next = top->scan + len;
+		switch (*sig) {
+		case SD_BUS_TYPE_VARIANT:
+			sig = signature_for_json(item);
+			if (sig == NULL || depth == MAX_DEPTH)
+				goto error;
+			rc = sd_bus_message_open_container(msg, SD_BUS_TYPE_VARIANT, sig);
+			if (rc < 0)
+				goto error;
+			top = &stack[++depth];
+			top->kind = Pack_Variant;
+			top->signature = sig;
+			top->list = item;
+			top->index = 0;
+			break;
 
-	default:
-		goto error;
-	}
+		case SD_BUS_TYPE_ARRAY:
+			if (depth == MAX_DEPTH)
+				goto error;
+			rc = opencontainer(msg, SD_BUS_TYPE_ARRAY, sig + 1, len - 1);
+			if (rc < 0)
+				goto error;
+			top = &stack[++depth];
+			if (json_object_is_type(item, json_type_array)) {
+				/* Is an array! */
+				top->kind = Pack_Array;
+				top->signature = sig + 1;
+				top->list = item;
+				top->index = 0;
+				top->count = (int)json_object_array_length(item);
+			} else {
+				/* Not an array! Check if it matches an string dictionnary */
+				if (!json_object_is_type(item, json_type_object)
+				 || sig[1] != SD_BUS_TYPE_DICT_ENTRY_BEGIN
+				 || sig[2] != SD_BUS_TYPE_STRING)
+					goto error;
+				top->kind = Pack_Dict;
+				top->signature = sig + 2;
+				top->len = len - 3;
+				top->it = json_object_iter_begin(item);
+				top->end = json_object_iter_end(item);
+				top->inentry = 0;
+			}
+			break;
 
-	rc = sd_bus_message_append_basic(msg, *signature, data);
-	if (rc < 0)
-		goto error;
-	return len;
+		case SD_BUS_TYPE_STRUCT_BEGIN:
+		case SD_BUS_TYPE_DICT_ENTRY_BEGIN:
+			if (depth == MAX_DEPTH)
+				goto error;
+			rc = opencontainer(msg,
+				*sig == SD_BUS_TYPE_STRUCT_BEGIN ? SD_BUS_TYPE_STRUCT : SD_BUS_TYPE_DICT_ENTRY,
+				sig + 1, len - 2);
+			if (rc < 0)
+				goto error;
+			top = &stack[++depth];
+			top->kind = Pack_Sequence;
+			top->signature = sig + 1;
+			top->len = len - 2;
+			top->scan = top->next = 0;
+			top->list = item;
+			top->index = 0;
+			top->count = json_object_is_type(item, json_type_array) ? (int)json_object_array_length(item) : 1;
+			break;
+
+		default:
+			rc = packbasic(msg, *sig, item);
+			if (rc < 0)
+				goto error;
+			break;
+		}
+	}
 
 error:
-	return -1;
+	return -(stack[0].scan + 1);
 }
 
-int jsonc2msg(struct sd_bus_message *msg, const char *signature, struct json_object *list)
+/*
+ * Unpack a D-Bus message to a json object
+ */
+int msg2jsonc(struct sd_bus_message *msg, struct json_object **result)
 {
-	int rc, count, index, scan;
-	struct json_object *item;
+	int prevpath = acct_enter(Acct_Msg2json);
+	int rc = unpack(msg, NULL, NULL, 0, result);
+	acct_leave(prevpath);
+	return rc;
+}
 
-	scan = 0;
-	if (list == NULL) {
-		/* empty case */
-		if (*signature)
-			goto error;
-		return scan;
-	}
+/*
+ * Unpack the selected values of a D-Bus message to a json object
+ * within the limits, returns -E2BIG when they are exceeded
+ */
+int msg2jsonc_limited(struct sd_bus_message *msg, const struct jsonc_select *select, struct jsonc_limits *limits,
+		unsigned flags, struct json_object **result)
+{
+	int prevpath = acct_enter(Acct_Msg2json);
+	int rc = unpack(msg, select, limits, flags, result);
+	acct_leave(prevpath);
+	return rc;
+}
 
-	if (!json_object_is_type(list, json_type_array)) {
-		/* down grade gracefully to single */
-		rc = packsingle(msg, signature, list);
-		if (rc < 0)
-			goto error;
-		scan = rc;
-		if (signature[scan] != 0)
-			goto error;
-		return scan;
+/*
+ * Add to the selection the path of components separated by slashes,
+ * the first component being the index of the argument
+ */
+int jsonc_select_add(struct jsonc_select **select, const char *path)
+{
+	struct jsonc_select *node, **prv;
+	const char *end;
+	size_t len;
+
+	/* the root */
+	if (*select == NULL) {
+		*select = calloc(1, sizeof **select + 1);
+		if (*select == NULL)
+			return -1;
 	}
+	node = *select;
+
+	/* the components */
+	while (!node->all) {
+		end = strchr(path, SELECT_SEPARATOR) ?: path + strlen(path);
+		len = (size_t)(end - path);
+		for (prv = &node->children ; *prv != NULL ; prv = &(*prv)->next)
+			if (!strncmp((*prv)->name, path, len) && !(*prv)->name[len])
+				break;
+		if (*prv == NULL) {
+			*prv = calloc(1, sizeof **prv + len + 1);
+			if (*prv == NULL)
+				return -1;
+			memcpy((*prv)->name, path, len);
+		}
+		node = *prv;
+		if (!*end) {
+			/* the last component selects all */
+			node->all = 1;
+			break;
+		}
+		path = end + 1;
+	}
+	return 0;
+}
 
-	/* iterate over elements */
-	count = (int)json_object_array_length(list);
-	index = 0;
-	for (;;) {
-		/* check state */
-		if (index == count && signature[scan] == 0)
-			return scan;
-		if (index == count || signature[scan] == 0)
-			goto error;
-
-		/* get the item */
-		item = json_object_array_get_idx(list, index);
-		if (item == NULL)
-			goto error;
-
-		/* pack the item */
-		rc = packsingle(msg, signature + scan, item);
-		if (rc < 0)
-			goto error;
+/*
+ * Release the selection
+ */
+void jsonc_select_destroy(struct jsonc_select *select)
+{
+	struct jsonc_select *next, **last;
 
-		/* advance */
-		scan += rc;
-		index++;
+	while (select != NULL) {
+		/* append the children to the siblings to be released */
+		if (select->children != NULL) {
+			for (last = &select->next ; *last != NULL ; last = &(*last)->next);
+			*last = select->children;
+		}
+		next = select->next;
+		free(select);
+		select = next;
 	}
-
-error:
-	return -(scan + 1);
 }
 
+/*
+ * Pack the json list to the message
+ */
+int jsonc2msg(struct sd_bus_message *msg, const char *signature, struct json_object *list)
+{
+	int prevpath = acct_enter(Acct_Json2msg);
+	int rc = pack(msg, signature, list);
+	acct_leave(prevpath);
+	return rc;
+}
@@ -17,9 +17,37 @@
 
 #pragma once
 
+#include <stddef.h>
+
 struct sd_bus_message;
 struct json_object;
+struct jsonc_select;
+
+/**
+ * flag of conversion replacing variants by their value and
+ * messages of one value by that value
+ */
+#define MSG2JSONC_COMPACT 1
+
+/**
+ * limits of the conversion of messages to json, zero for no limit
+ */
+struct jsonc_limits {
+	/** maximum estimated size in bytes of the result */
+	size_t max_size;
+	/** maximum count of json objects of the result */
+	size_t max_count;
+	/** estimated size in bytes of the last result */
+	size_t size;
+	/** count of json objects of the last result */
+	size_t count;
+};
 
 extern int msg2jsonc(struct sd_bus_message *msg, struct json_object **result);
+extern int msg2jsonc_limited(struct sd_bus_message *msg, const struct jsonc_select *select, struct jsonc_limits *limits,
+		unsigned flags, struct json_object **result);
 extern int jsonc2msg(struct sd_bus_message *msg, const char *signature, struct json_object *list);
 
+
+extern int jsonc_select_add(struct jsonc_select **select, const char *path);
+extern void jsonc_select_destroy(struct jsonc_select *select);
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * Native interface of the dbus binding for the bindings of the same binder.
+ *
+ * The function table is returned by the verb "native" of the API as a data
+ * of the type DBUS_NATIVE_TYPE_NAME, that is only available in process:
+ *
+ *     afb_api_call_sync(api, "dbus", "native", 0, NULL, &status, &n, &data);
+ *     native = afb_data_ro_pointer(data);
+ *
+ * The table stays valid for the life of the binder. The calls can be made
+ * from any thread: they are queued to the thread of the API.
+ *
+ * The messages are built and the replies and signals are received without
+ * JSON conversion. The build callbacks run in the thread of the API. The
+ * receive callbacks run in the thread of the API or, when an executor is
+ * given, in the context where the executor runs its jobs. The received
+ * message is only valid during the callback. The signals handed to an
+ * executor are private copies, without timestamps nor credentials.
+ */
+
+#include <stdint.h>
+
+struct sd_bus_message;
+
+/** name of the afb type of the function table */
+#define DBUS_NATIVE_TYPE_NAME "dbus-native"
+
+/** version of the function table */
+#define DBUS_NATIVE_VERSION 1
+
+/** opaque handle of native subscriptions */
+struct dbus_native_subscription;
+
+/** executor of the receive callbacks */
+struct dbus_native_executor
+{
+	/** queue the job for being executed later with arg */
+	void (*queue)(void *closure, void (*job)(void *arg), void *arg);
+	/** closure of queue */
+	void *closure;
+};
+
+/** append the arguments to msg, returns a negative value on error */
+typedef int (*dbus_native_build_cb_t)(struct sd_bus_message *msg, void *closure);
+
+/** receive the reply (NULL when status is a negative error code) */
+typedef void (*dbus_native_reply_cb_t)(void *closure, int status, struct sd_bus_message *reply);
+
+/** receive a signal */
+typedef void (*dbus_native_signal_cb_t)(void *closure, struct sd_bus_message *signal);
+
+/** function table of the version 1 */
+struct dbus_native_v1
+{
+	/** version of the table */
+	unsigned version;
+
+	/**
+	 * Calls asynchronously the method member.
+	 * The optional build callback appends the arguments.
+	 * The reply is called exactly once when the call is queued.
+	 * Returns 0 if queued or a negative error code.
+	 */
+	int (*call_async)(
+		const struct dbus_native_v1 *native,
+		const char *bus,
+		const char *destination,
+		const char *path,
+		const char *interface,
+		const char *member,
+		dbus_native_build_cb_t build,
+		dbus_native_reply_cb_t reply,
+		void *closure,
+		const struct dbus_native_executor *executor,
+		uint64_t timeout_usec);
+
+	/**
+	 * Subscribes to the signals of match.
+	 * Returns 0 and the handle in subscription or a negative error code.
+	 */
+	int (*subscribe)(
+		const struct dbus_native_v1 *native,
+		const char *bus,
+		const char *match,
+		dbus_native_signal_cb_t on_signal,
+		void *closure,
+		const struct dbus_native_executor *executor,
+		struct dbus_native_subscription **subscription);
+
+	/**
+	 * Unsubscribes. No callback of the subscription is called after
+	 * this function returned.
+	 */
+	void (*unsubscribe)(
+		const struct dbus_native_v1 *native,
+		struct dbus_native_subscription *subscription);
+
+	/**
+	 * Sends the signal member.
+	 * The optional build callback appends the arguments.
+	 * Returns 0 if queued or a negative error code.
+	 */
+	int (*signal)(
+		const struct dbus_native_v1 *native,
+		const char *bus,
+		const char *destination,
+		const char *path,
+		const char *interface,
+		const char *member,
+		dbus_native_build_cb_t build,
+		void *closure);
+};
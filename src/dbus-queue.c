@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "dbus-queue.h"
+
+/* initialize the queue of max jobs of jobsize bytes */
+int dbus_queue_init(struct dbus_queue *queue, int max, size_t jobsize)
+{
+	queue->jobs = calloc((size_t)max, jobsize);
+	if (queue->jobs == NULL)
+		return -ENOMEM;
+	queue->efd = eventfd(0, 0);
+	if (queue->efd < 0) {
+		free(queue->jobs);
+		queue->jobs = NULL;
+		return -errno;
+	}
+	pthread_mutex_init(&queue->mutex, NULL);
+	queue->closed = 0;
+	queue->jobsize = jobsize;
+	queue->max = max;
+	queue->count = 0;
+	return 0;
+}
+
+/* put a copy of the job in the queue, the consumer is to be woken after */
+int dbus_queue_put(struct dbus_queue *queue, const void *job)
+{
+	int rc = 0;
+
+	pthread_mutex_lock(&queue->mutex);
+	if (queue->jobs == NULL || queue->closed)
+		rc = -ENOTCONN;
+	else if (queue->count == queue->max)
+		/* ooooch! too many jobs !!! */
+		rc = -EBUSY;
+	else {
+		/* first, shift the pending jobs */
+		memmove(&queue->jobs[queue->jobsize], queue->jobs, (size_t)queue->count * queue->jobsize);
+		/* add the given job */
+		memcpy(queue->jobs, job, queue->jobsize);
+		queue->count++;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+	return rc;
+}
+
+/* get the oldest job, returns 0 when the queue is empty */
+int dbus_queue_get(struct dbus_queue *queue, void *job)
+{
+	int rc = 0;
+
+	pthread_mutex_lock(&queue->mutex);
+	if (queue->count > 0) {
+		queue->count--;
+		memcpy(job, &queue->jobs[(size_t)queue->count * queue->jobsize], queue->jobsize);
+		rc = 1;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+	return rc;
+}
+
+/* wake the consumer, returns 0 or a negative error code */
+int dbus_queue_wake(struct dbus_queue *queue)
+{
+	uint64_t inc = 1;
+	ssize_t rc;
+
+	do { rc = write(queue->efd, &inc, sizeof inc); } while (rc < 0 && errno == EINTR);
+	return rc < 0 ? -errno : 0;
+}
+
+/* wait to be woken, returns 0 or a negative error code */
+int dbus_queue_wait(struct dbus_queue *queue)
+{
+	uint64_t count;
+	ssize_t rc;
+
+	do { rc = read(queue->efd, &count, sizeof count); } while (rc < 0 && errno == EINTR);
+	return rc < 0 ? -errno : 0;
+}
+
+/* refuse the jobs put from now */
+void dbus_queue_close(struct dbus_queue *queue)
+{
+	pthread_mutex_lock(&queue->mutex);
+	queue->closed = 1;
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+/* count of pending jobs, read without lock */
+int dbus_queue_depth(struct dbus_queue *queue)
+{
+	return __atomic_load_n(&queue->count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * Bounded queue of the jobs of a DBUS thread
+ *
+ * Any thread puts jobs, copied in the queue, then wakes the consumer
+ * through the eventfd of the queue. The consumer gets them in their
+ * order of arrival.
+ */
+struct dbus_queue
+{
+	/** mutex of the queue */
+	pthread_mutex_t mutex;
+	/** eventfd waking the consumer */
+	int efd;
+	/** is the queue closed? */
+	int closed;
+	/** size of the jobs */
+	size_t jobsize;
+	/** size of the queue */
+	int max;
+	/** count of pending jobs */
+	int count;
+	/** pending jobs, the oldest last */
+	char *jobs;
+};
+
+extern int dbus_queue_init(struct dbus_queue *queue, int max, size_t jobsize);
+extern int dbus_queue_put(struct dbus_queue *queue, const void *job);
+extern int dbus_queue_get(struct dbus_queue *queue, void *job);
+extern int dbus_queue_wake(struct dbus_queue *queue);
+extern int dbus_queue_wait(struct dbus_queue *queue);
+extern void dbus_queue_close(struct dbus_queue *queue);
+extern int dbus_queue_depth(struct dbus_queue *queue);
@@ -0,0 +1,565 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * Compile time D-Bus signatures for C++20 callers.
+ *
+ * The signature given as template argument is parsed by the compiler and
+ * mapped to C++ types. The code packing and unpacking the messages is
+ * generated for these types: no signature is interpreted at run time and
+ * no JSON is involved.
+ *
+ *     using props = dbus::sig<"a{sv}">;
+ *     props::type values;      // std::tuple<std::map<std::string, dbus::variant>>
+ *     rc = props::unpack(msg, values);
+ *
+ *     rc = dbus::sig<"su">::pack(msg, "bzh.iot.dbus.binding", 0u);
+ *
+ * Types are mapped as follow:
+ *
+ *     y uint8_t      b bool         n int16_t      q uint16_t
+ *     i int32_t      u uint32_t     x int64_t      t uint64_t
+ *     d double       s std::string  o object_path  g signature
+ *     h unix_fd      v variant      aT std::vector<T>
+ *     a{KV} std::map<K,V>           (T...) std::tuple<T...>
+ *
+ * The type dbus::variant only holds basic values: unpacking a variant
+ * of another type fails with -ENOTSUP.
+ * The file descriptors of unix_fd are owned by the message.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <array>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <systemd/sd-bus.h>
+
+namespace dbus {
+
+/* string usable as template argument */
+template<std::size_t N>
+struct fixed_string
+{
+	char data[N];
+	constexpr fixed_string(const char (&text)[N]) { for (std::size_t i = 0 ; i < N ; i++) data[i] = text[i]; }
+	constexpr std::size_t size() const { return N - 1; }
+	constexpr char operator[](std::size_t i) const { return data[i]; }
+};
+
+/* object path */
+struct object_path { std::string value; bool operator==(const object_path&) const = default; };
+
+/* signature */
+struct signature { std::string value; bool operator==(const signature&) const = default; };
+
+/* unix file descriptor */
+struct unix_fd { int value; bool operator==(const unix_fd&) const = default; };
+
+/* variant of basic values */
+using variant = std::variant<std::monostate, uint8_t, bool, int16_t, uint16_t, int32_t, uint32_t,
+		int64_t, uint64_t, double, std::string, object_path, signature, unix_fd>;
+
+namespace detail {
+
+/* maximum depth of containers */
+constexpr unsigned max_depth = 64;
+
+/* is the character a basic type? */
+constexpr bool is_basic(char c)
+{
+	switch (c) {
+	case 'y': case 'b': case 'n': case 'q': case 'i': case 'u': case 'x':
+	case 't': case 'd': case 's': case 'o': case 'g': case 'h':
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* is the character a basic type of fixed size packed in arrays? */
+constexpr bool is_fixed(char c)
+{
+	return is_basic(c) && c != 'b' && c != 'h' && c != 's' && c != 'o' && c != 'g';
+}
+
+/* end of the complete type at pos or 0 when invalid */
+constexpr std::size_t end_of(const char *sig, std::size_t pos, std::size_t len, unsigned depth = 0)
+{
+	std::size_t end;
+
+	if (pos >= len || depth > max_depth)
+		return 0;
+	if (is_basic(sig[pos]) || sig[pos] == 'v')
+		return pos + 1;
+	if (sig[pos] == 'a') {
+		if (pos + 1 >= len || sig[pos + 1] != '{')
+			return end_of(sig, pos + 1, len, depth + 1);
+		if (pos + 2 >= len || !is_basic(sig[pos + 2]))
+			return 0;
+		end = end_of(sig, pos + 3, len, depth + 1);
+		return end != 0 && end < len && sig[end] == '}' ? end + 1 : 0;
+	}
+	if (sig[pos] == '(') {
+		end = pos + 1;
+		if (end < len && sig[end] == ')')
+			return 0;
+		while (end < len && sig[end] != ')') {
+			end = end_of(sig, end, len, depth + 1);
+			if (end == 0)
+				return 0;
+		}
+		return end < len ? end + 1 : 0;
+	}
+	return 0;
+}
+
+/* is the signature a valid sequence of complete types? */
+constexpr bool is_valid(const char *sig, std::size_t len)
+{
+	std::size_t pos = 0;
+	while (pos < len) {
+		pos = end_of(sig, pos, len);
+		if (pos == 0)
+			return false;
+	}
+	return true;
+}
+
+/* zero terminated copy of the part [B, E) of the signature */
+template<fixed_string S, std::size_t B, std::size_t E>
+struct substr
+{
+	static constexpr std::array<char, E - B + 1> value = [] {
+		std::array<char, E - B + 1> result{};
+		for (std::size_t i = B ; i < E ; i++)
+			result[i - B] = S[i];
+		return result;
+	}();
+	static constexpr const char *c_str() { return value.data(); }
+};
+
+/* basic values */
+template<class T, char C>
+struct basic
+{
+	using type = T;
+	static int pack(sd_bus_message *m, const T &value) { return sd_bus_message_append_basic(m, C, &value); }
+	static int unpack(sd_bus_message *m, T &value) { return sd_bus_message_read_basic(m, C, &value); }
+};
+
+template<>
+struct basic<bool, 'b'>
+{
+	using type = bool;
+	static int pack(sd_bus_message *m, const bool &value)
+	{
+		int i = value;
+		return sd_bus_message_append_basic(m, 'b', &i);
+	}
+	static int unpack(sd_bus_message *m, bool &value)
+	{
+		int i, rc = sd_bus_message_read_basic(m, 'b', &i);
+		value = i != 0;
+		return rc;
+	}
+};
+
+template<class T, char C>
+struct stringlike
+{
+	using type = T;
+	static int pack(sd_bus_message *m, const T &value) { return sd_bus_message_append_basic(m, C, get(value).c_str()); }
+	static int unpack(sd_bus_message *m, T &value)
+	{
+		const char *s;
+		int rc = sd_bus_message_read_basic(m, C, &s);
+		if (rc > 0)
+			get(value) = s;
+		return rc;
+	}
+	static const std::string &get(const std::string &v) { return v; }
+	static std::string &get(std::string &v) { return v; }
+	template<class W> static const std::string &get(const W &w) { return w.value; }
+	template<class W> static std::string &get(W &w) { return w.value; }
+};
+
+template<>
+struct basic<unix_fd, 'h'>
+{
+	using type = unix_fd;
+	static int pack(sd_bus_message *m, const unix_fd &value) { return sd_bus_message_append_basic(m, 'h', &value.value); }
+	static int unpack(sd_bus_message *m, unix_fd &value) { return sd_bus_message_read_basic(m, 'h', &value.value); }
+};
+
+/* codec of the basic type of code C */
+template<char C> struct basic_of;
+template<> struct basic_of<'y'> : basic<uint8_t, 'y'> {};
+template<> struct basic_of<'b'> : basic<bool, 'b'> {};
+template<> struct basic_of<'n'> : basic<int16_t, 'n'> {};
+template<> struct basic_of<'q'> : basic<uint16_t, 'q'> {};
+template<> struct basic_of<'i'> : basic<int32_t, 'i'> {};
+template<> struct basic_of<'u'> : basic<uint32_t, 'u'> {};
+template<> struct basic_of<'x'> : basic<int64_t, 'x'> {};
+template<> struct basic_of<'t'> : basic<uint64_t, 't'> {};
+template<> struct basic_of<'d'> : basic<double, 'd'> {};
+template<> struct basic_of<'s'> : stringlike<std::string, 's'> {};
+template<> struct basic_of<'o'> : stringlike<object_path, 'o'> {};
+template<> struct basic_of<'g'> : stringlike<signature, 'g'> {};
+template<> struct basic_of<'h'> : basic<unix_fd, 'h'> {};
+
+/* code of the basic type T */
+template<class T> constexpr char code_of = 0;
+template<> constexpr char code_of<uint8_t> = 'y';
+template<> constexpr char code_of<bool> = 'b';
+template<> constexpr char code_of<int16_t> = 'n';
+template<> constexpr char code_of<uint16_t> = 'q';
+template<> constexpr char code_of<int32_t> = 'i';
+template<> constexpr char code_of<uint32_t> = 'u';
+template<> constexpr char code_of<int64_t> = 'x';
+template<> constexpr char code_of<uint64_t> = 't';
+template<> constexpr char code_of<double> = 'd';
+template<> constexpr char code_of<std::string> = 's';
+template<> constexpr char code_of<object_path> = 'o';
+template<> constexpr char code_of<signature> = 'g';
+template<> constexpr char code_of<unix_fd> = 'h';
+
+/* variants of basic values */
+struct variant_codec
+{
+	using type = variant;
+
+	static int pack(sd_bus_message *m, const variant &value)
+	{
+		return std::visit([m](const auto &item) -> int {
+			using T = std::decay_t<decltype(item)>;
+			if constexpr (std::is_same_v<T, std::monostate>)
+				return -EINVAL;
+			else {
+				constexpr char contents[2] = { code_of<T>, 0 };
+				int rc = sd_bus_message_open_container(m, 'v', contents);
+				if (rc >= 0)
+					rc = basic_of<code_of<T>>::pack(m, item);
+				if (rc >= 0)
+					rc = sd_bus_message_close_container(m);
+				return rc;
+			}
+		}, value);
+	}
+
+	template<std::size_t I = 1>
+	static int read(sd_bus_message *m, char code, variant &value)
+	{
+		if constexpr (I == std::variant_size_v<variant>)
+			return -ENOTSUP;
+		else {
+			using T = std::variant_alternative_t<I, variant>;
+			if (code != code_of<T>)
+				return read<I + 1>(m, code, value);
+			return basic_of<code_of<T>>::unpack(m, value.emplace<I>());
+		}
+	}
+
+	static int unpack(sd_bus_message *m, variant &value)
+	{
+		const char *contents;
+		char type;
+		int rc = sd_bus_message_peek_type(m, &type, &contents);
+		if (rc <= 0)
+			return rc < 0 ? rc : -ENXIO;
+		if (type != 'v')
+			return -ENXIO;
+		value = std::monostate();
+		if (!is_basic(contents[0]) || contents[1] != 0)
+			return -ENOTSUP;
+		rc = sd_bus_message_enter_container(m, 'v', contents);
+		if (rc > 0)
+			rc = read(m, contents[0], value);
+		if (rc >= 0)
+			rc = sd_bus_message_exit_container(m);
+		return rc;
+	}
+};
+
+/* the complete type [B, E) of the signature */
+template<fixed_string S, std::size_t B, std::size_t E, char C = S[B]>
+struct element : basic_of<C> {};
+
+template<fixed_string S, std::size_t B, std::size_t E>
+struct element<S, B, E, 'v'> : variant_codec {};
+
+/* sequence of complete types */
+template<class... T>
+struct sequence
+{
+	using type = std::tuple<typename T::type...>;
+
+	template<class Tuple, std::size_t... I>
+	static int pack(sd_bus_message *m, const Tuple &values, std::index_sequence<I...>)
+	{
+		int rc = 0;
+		((rc = rc < 0 ? rc : T::pack(m, std::get<I>(values))), ...);
+		return rc;
+	}
+
+	template<class Tuple>
+	static int pack(sd_bus_message *m, const Tuple &values)
+	{
+		return pack(m, values, std::index_sequence_for<T...>());
+	}
+
+	template<class Tuple, std::size_t... I>
+	static int unpack(sd_bus_message *m, Tuple &&values, std::index_sequence<I...>)
+	{
+		int rc = 0;
+		((rc = rc < 0 ? rc : T::unpack(m, std::get<I>(values))), ...);
+		return rc;
+	}
+
+	template<class Tuple>
+	static int unpack(sd_bus_message *m, Tuple &&values)
+	{
+		return unpack(m, std::forward<Tuple>(values), std::index_sequence_for<T...>());
+	}
+};
+
+/* builds the sequence of the complete types of [B, E) */
+template<fixed_string S, std::size_t B, std::size_t E, class... T>
+struct sequence_of
+{
+	/* stops on invalid signatures, reported by the static assertion of sig */
+	static constexpr std::size_t next = end_of(S.data, B, S.size()) == 0 ? E : end_of(S.data, B, S.size());
+	using type = typename sequence_of<S, next, E, T..., element<S, B, next>>::type;
+};
+
+template<fixed_string S, std::size_t E, class... T>
+struct sequence_of<S, E, E, T...>
+{
+	using type = sequence<T...>;
+};
+
+/* arrays */
+template<fixed_string S, std::size_t B, std::size_t E, bool fixed = is_fixed(S[B + 1])>
+struct array
+{
+	using item = element<S, B + 1, E>;
+	using type = std::vector<typename item::type>;
+	using contents = substr<S, B + 1, E>;
+
+	static int pack(sd_bus_message *m, const type &values)
+	{
+		int rc = sd_bus_message_open_container(m, 'a', contents::c_str());
+		for (auto it = values.begin() ; rc >= 0 && it != values.end() ; ++it)
+			rc = item::pack(m, *it);
+		if (rc >= 0)
+			rc = sd_bus_message_close_container(m);
+		return rc;
+	}
+
+	static int unpack(sd_bus_message *m, type &values)
+	{
+		int rc = sd_bus_message_enter_container(m, 'a', contents::c_str());
+		if (rc <= 0)
+			return rc < 0 ? rc : -ENXIO;
+		values.clear();
+		while ((rc = sd_bus_message_at_end(m, 0)) == 0) {
+			if constexpr (std::is_same_v<typename item::type, bool>) {
+				/* the items of std::vector<bool> are proxies */
+				bool value;
+				rc = item::unpack(m, value);
+				values.push_back(value);
+			}
+			else
+				rc = item::unpack(m, values.emplace_back());
+			if (rc < 0)
+				return rc;
+		}
+		if (rc >= 0)
+			rc = sd_bus_message_exit_container(m);
+		return rc;
+	}
+};
+
+/* arrays of fixed size values are copied at once */
+template<fixed_string S, std::size_t B, std::size_t E>
+struct array<S, B, E, true>
+{
+	using item = basic_of<S[B + 1]>;
+	using type = std::vector<typename item::type>;
+
+	static int pack(sd_bus_message *m, const type &values)
+	{
+		return sd_bus_message_append_array(m, S[B + 1], values.data(), values.size() * sizeof(typename item::type));
+	}
+
+	static int unpack(sd_bus_message *m, type &values)
+	{
+		const void *ptr;
+		size_t size;
+		int rc = sd_bus_message_read_array(m, S[B + 1], &ptr, &size);
+		if (rc >= 0) {
+			auto first = static_cast<const typename item::type*>(ptr);
+			values.assign(first, first + size / sizeof(typename item::type));
+		}
+		return rc;
+	}
+};
+
+/* dictionaries */
+template<fixed_string S, std::size_t B, std::size_t E>
+struct dict
+{
+	using key = element<S, B + 2, B + 3>;
+	using value = element<S, B + 3, E - 1>;
+	using type = std::map<typename key::type, typename value::type>;
+	using contents = substr<S, B + 1, E>;
+	using entry = substr<S, B + 2, E - 1>;
+
+	static int pack(sd_bus_message *m, const type &values)
+	{
+		int rc = sd_bus_message_open_container(m, 'a', contents::c_str());
+		for (auto it = values.begin() ; rc >= 0 && it != values.end() ; ++it) {
+			rc = sd_bus_message_open_container(m, 'e', entry::c_str());
+			if (rc >= 0)
+				rc = key::pack(m, it->first);
+			if (rc >= 0)
+				rc = value::pack(m, it->second);
+			if (rc >= 0)
+				rc = sd_bus_message_close_container(m);
+		}
+		if (rc >= 0)
+			rc = sd_bus_message_close_container(m);
+		return rc;
+	}
+
+	static int unpack(sd_bus_message *m, type &values)
+	{
+		typename key::type k;
+		int rc = sd_bus_message_enter_container(m, 'a', contents::c_str());
+		if (rc <= 0)
+			return rc < 0 ? rc : -ENXIO;
+		values.clear();
+		while ((rc = sd_bus_message_enter_container(m, 'e', entry::c_str())) > 0) {
+			rc = key::unpack(m, k);
+			if (rc >= 0)
+				rc = value::unpack(m, values[k]);
+			if (rc >= 0)
+				rc = sd_bus_message_exit_container(m);
+			if (rc < 0)
+				return rc;
+		}
+		if (rc >= 0)
+			rc = sd_bus_message_exit_container(m);
+		return rc;
+	}
+};
+
+template<fixed_string S, std::size_t B, std::size_t E, bool isdict = S[B + 1] == '{'>
+struct array_or_dict : array<S, B, E> {};
+
+template<fixed_string S, std::size_t B, std::size_t E>
+struct array_or_dict<S, B, E, true> : dict<S, B, E> {};
+
+template<fixed_string S, std::size_t B, std::size_t E>
+struct element<S, B, E, 'a'> : array_or_dict<S, B, E> {};
+
+/* structures */
+template<fixed_string S, std::size_t B, std::size_t E>
+struct element<S, B, E, '('>
+{
+	using fields = typename sequence_of<S, B + 1, E - 1>::type;
+	using type = typename fields::type;
+	using contents = substr<S, B + 1, E - 1>;
+
+	static int pack(sd_bus_message *m, const type &values)
+	{
+		int rc = sd_bus_message_open_container(m, 'r', contents::c_str());
+		if (rc >= 0)
+			rc = fields::pack(m, values);
+		if (rc >= 0)
+			rc = sd_bus_message_close_container(m);
+		return rc;
+	}
+
+	static int unpack(sd_bus_message *m, type &values)
+	{
+		int rc = sd_bus_message_enter_container(m, 'r', contents::c_str());
+		if (rc <= 0)
+			return rc < 0 ? rc : -ENXIO;
+		rc = fields::unpack(m, values);
+		if (rc >= 0)
+			rc = sd_bus_message_exit_container(m);
+		return rc;
+	}
+};
+
+} /* namespace detail */
+
+/*
+ * The signature S: its C++ type is the tuple of the types of its
+ * complete types. The functions return a negative error code on failure.
+ */
+template<fixed_string S>
+struct sig
+{
+	static_assert(detail::is_valid(S.data, S.size()), "invalid D-Bus signature");
+
+	using sequence = typename detail::sequence_of<S, 0, S.size()>::type;
+	using type = typename sequence::type;
+
+	/* the signature as text */
+	static constexpr const char *text() { return S.data; }
+
+	/* append the values to the message */
+	template<class... A>
+	static int pack(sd_bus_message *m, const A &...values)
+	{
+		static_assert(sizeof...(A) == std::tuple_size_v<type>, "count of values mismatch the signature");
+		return sequence::pack(m, std::forward_as_tuple(values...));
+	}
+
+	/* append the tuple of values to the message */
+	static int pack_tuple(sd_bus_message *m, const type &values)
+	{
+		return sequence::pack(m, values);
+	}
+
+	/* read the values from the message */
+	static int unpack(sd_bus_message *m, type &values)
+	{
+		return sequence::unpack(m, values);
+	}
+
+	/* read the values from the message into the variables */
+	template<class... A>
+	static int unpack(sd_bus_message *m, A &...values)
+	{
+		static_assert(sizeof...(A) == std::tuple_size_v<type>, "count of values mismatch the signature");
+		return sequence::unpack(m, std::tie(values...));
+	}
+};
+
+} /* namespace dbus */
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbus-subs.h"
+
+/* generic unlink of an item of a list pnxt (with next on first position) */
+static void unlinklistitem(void *item, void *pnxt)
+{
+	void *nxt = *(void**)pnxt;
+	if (nxt != item)
+		unlinklistitem(item, nxt);
+	else
+		*(void**)pnxt = *(void**)item;
+}
+
+/* initialize the subscriptions */
+void dbus_subs_init(struct dbus_subs *subs, const struct dbus_subs_itf *itf, void *closure, pthread_mutex_t *watchlock)
+{
+	subs->watchers = NULL;
+	subs->evts = NULL;
+	subs->watchlock = watchlock;
+	subs->itf = itf;
+	subs->closure = closure;
+}
+
+/*****************************************************************************************/
+/* manage event records (evrec) */
+/*****************************************************************************************/
+
+/* search in the list */
+struct dbus_subs_evrec *dbus_subs_search_evrec(struct dbus_subs *subs, const char *name)
+{
+	struct dbus_subs_evrec *evrec = subs->evts;
+	while(evrec != NULL && strcmp(name, evrec->name))
+		evrec = evrec->next;
+	return evrec;
+}
+
+/* search in the list or create and add in the list */
+struct dbus_subs_evrec *dbus_subs_event(struct dbus_subs *subs, const char *name)
+{
+	struct dbus_subs_evrec *evrec = dbus_subs_search_evrec(subs, name);
+	if (evrec == NULL) {
+		evrec = subs->itf->create_evrec(subs->closure, name);
+		if (evrec != NULL) {
+			evrec->refcnt = 0;
+			evrec->next = subs->evts;
+			subs->evts = evrec;
+		}
+	}
+	return evrec;
+}
+
+/* remove from the list */
+static void remove_evrec(struct dbus_subs *subs, struct dbus_subs_evrec *evrec)
+{
+	unlinklistitem(evrec, &subs->evts);
+	subs->itf->release_evrec(subs->closure, evrec);
+}
+
+/*****************************************************************************************/
+/* manage dbus matchers (watch) */
+/*****************************************************************************************/
+
+/* search in the list */
+struct dbus_subs_watch *dbus_subs_search_watch(struct dbus_subs *subs, const struct dbus_subs_spec *spec)
+{
+	struct dbus_subs_watch *watch;
+	for (watch = subs->watchers ; watch != NULL ; watch = watch->next) {
+		if (!strcmp(spec->busname, watch->busname) && !strcmp(spec->match, watch->match)
+		 && !strcmp(spec->select, watch->select))
+			break;
+	}
+	return watch;
+}
+
+/* create and add in the list */
+static struct dbus_subs_watch *create_watch(struct dbus_subs *subs, const struct dbus_subs_spec *spec)
+{
+	struct dbus_subs_watch *watch = subs->itf->create_watch(subs->closure, spec);
+	if (watch != NULL) {
+		watch->evlist = NULL;
+		if (subs->watchlock != NULL)
+			pthread_mutex_lock(subs->watchlock);
+		watch->next = subs->watchers;
+		subs->watchers = watch;
+		if (subs->watchlock != NULL)
+			pthread_mutex_unlock(subs->watchlock);
+	}
+	return watch;
+}
+
+/* remove from the list */
+static void remove_watch(struct dbus_subs *subs, struct dbus_subs_watch *watch)
+{
+	if (subs->watchlock != NULL)
+		pthread_mutex_lock(subs->watchlock);
+	unlinklistitem(watch, &subs->watchers);
+	if (subs->watchlock != NULL)
+		pthread_mutex_unlock(subs->watchlock);
+	subs->itf->release_watch(subs->closure, watch);
+}
+
+/*****************************************************************************************/
+/* manage items linking matches (watch) to events */
+/*****************************************************************************************/
+
+/* search in the list */
+struct dbus_subs_evlist *dbus_subs_search_evlist(struct dbus_subs_watch *watch, struct dbus_subs_evrec *evrec)
+{
+	struct dbus_subs_evlist *evlist = watch->evlist;
+	while(evlist != NULL && evlist->evrec != evrec)
+		evlist = evlist->next;
+	return evlist;
+}
+
+/* create and add in the list */
+static struct dbus_subs_evlist *create_evlist(struct dbus_subs_watch *watch, struct dbus_subs_evrec *evrec)
+{
+	struct dbus_subs_evlist *evlist = malloc(sizeof *evlist);
+	if (evlist != NULL) {
+		evlist->evrec = evrec;
+		evlist->refcnt = 0;
+		evlist->next = watch->evlist;
+		watch->evlist = evlist;
+	}
+	return evlist;
+}
+
+/* remove from the list */
+static void remove_evlist(struct dbus_subs_watch *watch, struct dbus_subs_evlist *evlist)
+{
+	unlinklistitem(evlist, &watch->evlist);
+	free(evlist);
+}
+
+/*****************************************************************************************/
+/* manage subscriptions */
+/*****************************************************************************************/
+
+/* remove a subscription of the event to the match */
+void dbus_subs_remove(struct dbus_subs *subs, struct dbus_subs_watch *watch, struct dbus_subs_evlist *evlist)
+{
+	struct dbus_subs_evrec *evrec = evlist->evrec;
+
+	if (evlist->refcnt > 1)
+		evlist->refcnt--;
+	else {
+		remove_evlist(watch, evlist);
+		if (watch->evlist == NULL)
+			remove_watch(subs, watch);
+		if (evrec->refcnt > 1)
+			evrec->refcnt--;
+		else
+			remove_evrec(subs, evrec);
+	}
+}
+
+/* add a subscription of the event to the match, returns the event or NULL on error */
+struct dbus_subs_evrec *dbus_subs_add(struct dbus_subs *subs, const struct dbus_subs_spec *spec)
+{
+	struct dbus_subs_watch *watch;
+	struct dbus_subs_evrec *evrec;
+	struct dbus_subs_evlist *evlist;
+
+	/* search the watcher and the event */
+	watch = dbus_subs_search_watch(subs, spec);
+	evrec = dbus_subs_event(subs, spec->event);
+	if (watch == NULL)
+		watch = create_watch(subs, spec);
+	if (watch == NULL || evrec == NULL)
+		return NULL;
+
+	evlist = dbus_subs_search_evlist(watch, evrec);
+	if (evlist != NULL)
+		evlist->refcnt++;
+	else {
+		/* add the link */
+		evlist = create_evlist(watch, evrec);
+		if (evlist == NULL)
+			return NULL;
+		evlist->refcnt++;
+		evrec->refcnt++;
+	}
+
+	/* start the watch, also retrying a watch not started */
+	if (subs->itf->start_watch(subs->closure, watch) < 0) {
+		dbus_subs_remove(subs, watch, evlist);
+		return NULL;
+	}
+	return evrec;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+/*
+ * Subscriptions of events to matches of signals
+ *
+ * A match (watch) is identified by its bus, its rule and its selection,
+ * an event (evrec) by its name. The subscriptions of an event to a match
+ * are counted by the link (evlist) of the match to the event, and each
+ * link counts once for its event. A watch is released with its last link,
+ * an event with its last count.
+ *
+ * The watches and the events are created and released by the user of the
+ * lists through its interface. Its structures begin with the structures
+ * below.
+ */
+
+/*
+ * record of a named event
+ */
+struct dbus_subs_evrec
+{
+	/** link to next */
+	struct dbus_subs_evrec *next;
+	/** reference count */
+	unsigned refcnt;
+	/** name */
+	const char *name;
+};
+
+/*
+ * link of a match to an event
+ */
+struct dbus_subs_evlist
+{
+	/** link to next */
+	struct dbus_subs_evlist *next;
+	/** link to the event */
+	struct dbus_subs_evrec *evrec;
+	/** reference count */
+	unsigned refcnt;
+};
+
+/*
+ * watcher of signals
+ */
+struct dbus_subs_watch
+{
+	/** link to next */
+	struct dbus_subs_watch *next;
+	/** attached events */
+	struct dbus_subs_evlist *evlist;
+	/** name of bus */
+	const char *busname;
+	/** match filter */
+	const char *match;
+	/** selection as text, empty when all */
+	const char *select;
+};
+
+/*
+ * specification of a subscription
+ */
+struct dbus_subs_spec
+{
+	const char *busname;
+	const char *match;
+	const char *select;
+	const char *event;
+};
+
+/*
+ * interface of the user of the lists
+ */
+struct dbus_subs_itf
+{
+	/** create the event of name, NULL on error */
+	struct dbus_subs_evrec *(*create_evrec)(void *closure, const char *name);
+	/** release the event */
+	void (*release_evrec)(void *closure, struct dbus_subs_evrec *evrec);
+	/** create the watch of the specification, NULL on error */
+	struct dbus_subs_watch *(*create_watch)(void *closure, const struct dbus_subs_spec *spec);
+	/** start the watch if not already done, negative on error */
+	int (*start_watch)(void *closure, struct dbus_subs_watch *watch);
+	/** release the watch */
+	void (*release_watch)(void *closure, struct dbus_subs_watch *watch);
+};
+
+/*
+ * the subscriptions
+ */
+struct dbus_subs
+{
+	/** the list of watches */
+	struct dbus_subs_watch *watchers;
+	/** the list of events */
+	struct dbus_subs_evrec *evts;
+	/** mutex of the changes of the list of watches or NULL */
+	pthread_mutex_t *watchlock;
+	/** interface of the user */
+	const struct dbus_subs_itf *itf;
+	/** closure of the interface */
+	void *closure;
+};
+
+extern void dbus_subs_init(struct dbus_subs *subs, const struct dbus_subs_itf *itf, void *closure, pthread_mutex_t *watchlock);
+extern struct dbus_subs_evrec *dbus_subs_search_evrec(struct dbus_subs *subs, const char *name);
+extern struct dbus_subs_watch *dbus_subs_search_watch(struct dbus_subs *subs, const struct dbus_subs_spec *spec);
+extern struct dbus_subs_evlist *dbus_subs_search_evlist(struct dbus_subs_watch *watch, struct dbus_subs_evrec *evrec);
+extern struct dbus_subs_evrec *dbus_subs_event(struct dbus_subs *subs, const char *name);
+extern struct dbus_subs_evrec *dbus_subs_add(struct dbus_subs *subs, const struct dbus_subs_spec *spec);
+extern void dbus_subs_remove(struct dbus_subs *subs, struct dbus_subs_watch *watch, struct dbus_subs_evlist *evlist);
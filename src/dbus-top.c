@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "dbus-top.h"
+
+/*
+ * Counts are not decayed in place: each hit adds the weight
+ * 2^((now - landmark) / halflife) so that all counts keep the
+ * same scale. The landmark moves forward when weights grow too big.
+ */
+
+/* weight above which counts are rescaled */
+#define RESCALE 1e100
+
+/* initialize the sketch */
+void dbus_top_init(struct dbus_top *top, uint64_t halflife)
+{
+	top->halflife = halflife;
+	top->landmark = 0;
+	top->used = 0;
+}
+
+/* weight of a hit at now */
+static double weight(struct dbus_top *top, uint64_t now)
+{
+	return exp2((double)(int64_t)(now - top->landmark) / (double)top->halflife);
+}
+
+/* move the landmark to now */
+static void rescale(struct dbus_top *top, uint64_t now)
+{
+	double factor = 1.0 / weight(top, now);
+	unsigned idx;
+
+	for (idx = 0 ; idx < top->used ; idx++) {
+		top->entries[idx].count *= factor;
+		top->entries[idx].error *= factor;
+	}
+	top->landmark = now;
+}
+
+/* record a hit of the key made of the parts */
+void dbus_top_hit(struct dbus_top *top, uint64_t now, unsigned nparts, const char *parts[])
+{
+	char key[DBUS_TOP_KEYLEN];
+	struct dbus_top_entry *entry, *min;
+	unsigned length, idx, len;
+	double w;
+
+	/* make the key */
+	for (length = idx = 0 ; idx < nparts && length < DBUS_TOP_KEYLEN ; idx++) {
+		len = (unsigned)strnlen(parts[idx] ?: "", DBUS_TOP_KEYLEN - length - 1);
+		memcpy(&key[length], parts[idx] ?: "", len);
+		length += len;
+		key[length++] = 0;
+	}
+
+	w = weight(top, now);
+	if (w > RESCALE) {
+		rescale(top, now);
+		w = 1.0;
+	}
+
+	/* search the key and the minimum */
+	min = NULL;
+	for (idx = 0 ; idx < top->used ; idx++) {
+		entry = &top->entries[idx];
+		if (entry->length == length && !memcmp(entry->key, key, length)) {
+			entry->count += w;
+			return;
+		}
+		if (min == NULL || entry->count < min->count)
+			min = entry;
+	}
+
+	/* new key takes a free entry or replaces the minimum */
+	if (top->used < DBUS_TOP_SIZE) {
+		entry = &top->entries[top->used++];
+		entry->count = w;
+		entry->error = 0;
+	}
+	else {
+		entry = min;
+		entry->error = entry->count;
+		entry->count += w;
+	}
+	entry->length = length;
+	memcpy(entry->key, key, length);
+}
+
+/* compare ranks by decreasing rate */
+static int cmprank(const void *a, const void *b)
+{
+	const struct dbus_top_rank *ra = a, *rb = b;
+	return (ra->rate < rb->rate) - (ra->rate > rb->rate);
+}
+
+/* get the ranking of keys by decreasing rate, returns the count of ranks */
+unsigned dbus_top_rank(struct dbus_top *top, uint64_t now, struct dbus_top_rank ranks[DBUS_TOP_SIZE])
+{
+	/* a steady rate r accumulates r * halflife / ln(2) */
+	double factor = 1e9 * M_LN2 / ((double)top->halflife * weight(top, now));
+	unsigned idx;
+
+	for (idx = 0 ; idx < top->used ; idx++) {
+		ranks[idx].entry = &top->entries[idx];
+		ranks[idx].rate = top->entries[idx].count * factor;
+		ranks[idx].error = top->entries[idx].error * factor;
+	}
+	qsort(ranks, top->used, sizeof *ranks, cmprank);
+	return top->used;
+}
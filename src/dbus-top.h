@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* count of keys tracked by a sketch */
+#define DBUS_TOP_SIZE 32
+
+/* maximum size of the keys, longer keys are truncated */
+#define DBUS_TOP_KEYLEN 200
+
+/*
+ * entry of a sketch
+ */
+struct dbus_top_entry
+{
+	/** scaled count */
+	double count;
+	/** scaled overestimation of the count */
+	double error;
+	/** length of the key */
+	unsigned length;
+	/** the key, its parts separated by zeros */
+	char key[DBUS_TOP_KEYLEN];
+};
+
+/*
+ * Space-Saving sketch of the heavy hitters with exponentially decayed counts
+ */
+struct dbus_top
+{
+	/** half-life of counts in nanoseconds */
+	uint64_t halflife;
+	/** time origin of the scale of counts */
+	uint64_t landmark;
+	/** count of used entries */
+	unsigned used;
+	/** the entries */
+	struct dbus_top_entry entries[DBUS_TOP_SIZE];
+};
+
+/*
+ * rank of a key
+ */
+struct dbus_top_rank
+{
+	/** the entry */
+	const struct dbus_top_entry *entry;
+	/** decayed rate in hits per second */
+	double rate;
+	/** overestimation of the rate */
+	double error;
+};
+
+extern void dbus_top_init(struct dbus_top *top, uint64_t halflife);
+extern void dbus_top_hit(struct dbus_top *top, uint64_t now, unsigned nparts, const char *parts[]);
+extern unsigned dbus_top_rank(struct dbus_top *top, uint64_t now, struct dbus_top_rank ranks[DBUS_TOP_SIZE]);
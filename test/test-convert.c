@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the conversions of dbus-jsonc.c: JSON values are packed with
+ * a signature, unpacked again and compared to the expected results.
+ * Malformed signatures and containers nested beyond the limit must fail.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <systemd/sd-bus.h>
+#include <json-c/json.h>
+
+#include "dbus-jsonc.h"
+
+/* maximum depth of containers of dbus-jsonc.c */
+#define MAX_DEPTH 64
+
+static sd_bus *bus;
+static int failures = 0;
+
+/* signatures, JSON packed and the JSON unpacked again or NULL when packing fails */
+static const char *checks[][3] = {
+	/* valid signatures */
+	{ "i", "5", "[5]" },
+	{ "ii", "[1,2]", "[1,2]" },
+	{ "ii", "[1]", NULL },
+	{ "y", "300", NULL },
+	{ "s", "\"text\"", "[\"text\"]" },
+	{ "as", "[[\"a\",\"b\"]]", "[[\"a\",\"b\"]]" },
+	{ "ad", "[[1.5,-2,1e300]]", "[[1.5,-2.0,1e+300]]" },
+	{ "v", "[[1,\"x\",true]]", "[[[[1],[\"x\"],[true]]]]" },
+	{ "av", "[[null]]", NULL },
+	{ "aai", "[[[1,2],[],[3]]]", "[[[1,2],[],[3]]]" },
+	{ "a{sv}", "[{}]", "[{}]" },
+	{ "a{sv}", "[{\"a\":1}]", "[{\"a\":[1]}]" },
+	{ "a{ii}", "[[[1,2]]]", NULL },
+	{ "(ii)", "[[1,2]]", "[[1,2]]" },
+	{ "a(sv)", "[[[\"a\",1]]]", "[[[\"a\",[1]]]]" },
+	{ "", "[]", "[]" },
+	{ "", "[1]", NULL },
+	/* malformed signatures */
+	{ "a", "[[]]", NULL },
+	{ "{sv}", "[[\"a\",1]]", NULL },
+	{ "(", "[[]]", NULL },
+	{ ")", "[[]]", NULL },
+	{ "()", "[[]]", NULL },
+	{ "(i", "[[1]]", NULL },
+	{ "i)", "[1]", NULL },
+	{ "a{", "[{}]", NULL },
+	{ "a{sv", "[{}]", NULL },
+	{ "a{s}", "[{}]", NULL },
+	{ "a{svs}", "[{}]", NULL },
+	{ "a{vs}", "[[]]", NULL },
+	{ "a{(i)s}", "[[]]", NULL },
+	{ "z", "[1]", NULL },
+};
+
+/* report the failure of the check */
+static void check(int ok, const char *what, const char *detail)
+{
+	if (!ok) {
+		fprintf(stderr, "FAILED %s %s\n", what, detail);
+		failures++;
+	}
+}
+
+/* a new signal message of the bus */
+static sd_bus_message *new_message(void)
+{
+	sd_bus_message *msg = NULL;
+	int rc = sd_bus_message_new_signal(bus, &msg, "/test", "bzh.iot.test", "Test");
+	check(rc >= 0, "new message", "");
+	return msg;
+}
+
+/* seal the message and rewind it for reading */
+static int seal(sd_bus_message *msg)
+{
+	static uint64_t cookie = 0;
+	int rc = sd_bus_message_seal(msg, ++cookie, 0);
+	if (rc >= 0)
+		rc = sd_bus_message_rewind(msg, 1);
+	return rc;
+}
+
+/* text of the JSON conversion of the sealed message or NULL on error */
+static char *text_of(sd_bus_message *msg)
+{
+	char *text;
+	struct json_object *obj;
+
+	if (msg2jsonc(msg, &obj) < 0)
+		return NULL;
+	text = strdup(json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN));
+	json_object_put(obj);
+	return text;
+}
+
+/* packs and unpacks the checks */
+static void check_table(void)
+{
+	unsigned i;
+	int rc;
+	char *text;
+	sd_bus_message *msg;
+	struct json_object *obj;
+
+	for (i = 0 ; i < sizeof checks / sizeof *checks ; i++) {
+		obj = json_tokener_parse(checks[i][1]);
+		msg = new_message();
+		if (msg == NULL)
+			return;
+		rc = jsonc2msg(msg, checks[i][0], obj);
+		text = rc < 0 || seal(msg) < 0 ? NULL : text_of(msg);
+		if (text != checks[i][2] && (text == NULL || checks[i][2] == NULL || strcmp(text, checks[i][2]))) {
+			fprintf(stderr, "FAILED '%s' %s gives %s expected %s\n",
+				checks[i][0], checks[i][1], text ?: "an error", checks[i][2] ?: "an error");
+			failures++;
+		}
+		free(text);
+		sd_bus_message_unref(msg);
+		json_object_put(obj);
+	}
+}
+
+/* unpacks the value 42 within count nested variants */
+static void check_unpack_depth(int count, int expected)
+{
+	int i, rc;
+	char *text, what[32];
+	sd_bus_message *msg = new_message();
+
+	if (msg == NULL)
+		return;
+	snprintf(what, sizeof what, "unpack depth %d", count);
+	rc = 0;
+	for (i = 1 ; rc >= 0 && i < count ; i++)
+		rc = sd_bus_message_open_container(msg, 'v', "v");
+	if (rc >= 0)
+		rc = sd_bus_message_append(msg, "v", "i", 42);
+	for (i = 1 ; rc >= 0 && i < count ; i++)
+		rc = sd_bus_message_close_container(msg);
+	if (rc >= 0)
+		rc = seal(msg);
+	check(rc >= 0, what, "message");
+	text = text_of(msg);
+	check((text != NULL) == expected, what, text ? "succeeds" : "fails");
+	free(text);
+	sd_bus_message_unref(msg);
+}
+
+/* JSON of the value 42 within count nested arrays */
+static struct json_object *nested_arrays(int count)
+{
+	struct json_object *obj, *array;
+
+	obj = json_object_new_int(42);
+	while (count-- > 0) {
+		array = json_object_new_array();
+		json_object_array_add(array, obj);
+		obj = array;
+	}
+	return obj;
+}
+
+/* packs with the signature the value 42 within count nested arrays */
+static void check_pack_depth(const char *signature, int count, int expected)
+{
+	int rc;
+	char what[32];
+	struct json_object *obj;
+	sd_bus_message *msg = new_message();
+
+	if (msg == NULL)
+		return;
+	snprintf(what, sizeof what, "pack depth '%s' %d", signature, count);
+	obj = nested_arrays(count);
+	rc = jsonc2msg(msg, signature, obj);
+	check((rc >= 0) == expected, what, rc >= 0 ? "succeeds" : "fails");
+	json_object_put(obj);
+	sd_bus_message_unref(msg);
+}
+
+int main(void)
+{
+	sd_id128_t id = {};
+	int fds[2];
+
+	/* messages need a started bus, a private socket is enough */
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0
+	 || sd_bus_new(&bus) < 0
+	 || sd_bus_set_fd(bus, fds[0], fds[0]) < 0
+	 || sd_bus_set_server(bus, 1, id) < 0
+	 || sd_bus_set_anonymous(bus, 1) < 0
+	 || sd_bus_start(bus) < 0) {
+		fprintf(stderr, "can't create the bus\n");
+		return 1;
+	}
+
+	check_table();
+
+	/* each variant is a container */
+	check_unpack_depth(MAX_DEPTH, 1);
+	check_unpack_depth(MAX_DEPTH + 1, 0);
+
+	/* the outer array is the list of arguments, each inner array is
+	 * packed in a variant, so the depth is 2 * count - 2 for av and one
+	 * more for (av) whose structure takes one more array */
+	check_pack_depth("av", MAX_DEPTH / 2 + 1, 1);
+	check_pack_depth("(av)", MAX_DEPTH / 2 + 2, 0);
+
+	sd_bus_close(bus);
+	sd_bus_unref(bus);
+	close(fds[1]);
+	if (failures != 0)
+		return 1;
+	puts("ok");
+	return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the copies of dbus-copy.c as the binding uses them when a JSON
+ * watch and an executor subscription match the same signal: the DBUS
+ * thread converts the received signal to JSON while the executor thread
+ * reads its copy. Both must read the whole body of the signal.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <systemd/sd-bus.h>
+#include <json-c/json.h>
+
+#include "dbus-jsonc.h"
+#include "dbus-copy.h"
+
+/** count of signals delivered */
+#define COUNT 2000
+
+/** the body of the signals */
+#define SIGNATURE "sa{sv}ai"
+#define JSON "[\"name\",{\"a\":1,\"b\":\"text\",\"c\":true},[1,2,3,4,5,6,7,8]]"
+
+static sd_bus *bus;
+static int failures = 0;
+static char *expected;
+
+/* report the failure of the check */
+static void check(int ok, const char *what, const char *detail)
+{
+	if (!ok) {
+		fprintf(stderr, "FAILED %s %s\n", what, detail);
+		__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+	}
+}
+
+/* text of the JSON conversion of the rewound message or NULL on error */
+static char *text_of(sd_bus_message *msg)
+{
+	char *text;
+	struct json_object *obj;
+
+	if (sd_bus_message_rewind(msg, 1) < 0 || msg2jsonc(msg, &obj) < 0)
+		return NULL;
+	text = strdup(json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN));
+	json_object_put(obj);
+	return text;
+}
+
+/* a new sealed signal of the bus, as received */
+static sd_bus_message *new_signal(uint64_t cookie)
+{
+	int rc;
+	sd_bus_message *msg = NULL;
+	struct json_object *obj = json_tokener_parse(JSON);
+
+	rc = sd_bus_message_new_signal(bus, &msg, "/test", "bzh.iot.test", "Test");
+	if (rc >= 0)
+		rc = sd_bus_message_set_sender(msg, ":1.42");
+	if (rc >= 0)
+		rc = jsonc2msg(msg, SIGNATURE, obj);
+	if (rc >= 0)
+		rc = sd_bus_message_seal(msg, cookie, 0);
+	json_object_put(obj);
+	check(rc >= 0, "new signal", "");
+	if (rc < 0)
+		msg = sd_bus_message_unref(msg);
+	return msg;
+}
+
+/* the header fields and the body of the copy are the ones of the signal */
+static void check_fields(sd_bus_message *msg, sd_bus_message *copy)
+{
+	uint64_t cookie = 0, copied = 1;
+	char *text;
+
+	check(!strcmp(sd_bus_message_get_path(copy), "/test"), "copy", "path");
+	check(!strcmp(sd_bus_message_get_interface(copy), "bzh.iot.test"), "copy", "interface");
+	check(!strcmp(sd_bus_message_get_member(copy), "Test"), "copy", "member");
+	check(!strcmp(sd_bus_message_get_sender(copy), ":1.42"), "copy", "sender");
+	check(!strcmp(sd_bus_message_get_signature(copy, 1), SIGNATURE), "copy", "signature");
+	sd_bus_message_get_cookie(msg, &cookie);
+	sd_bus_message_get_cookie(copy, &copied);
+	check(cookie == copied, "copy", "cookie");
+	text = text_of(copy);
+	check(text != NULL && !strcmp(text, expected), "copy", text ?: "not converted");
+	free(text);
+}
+
+/* the executor thread reads the copies it receives */
+static void *executor(void *arg)
+{
+	int *fd = arg;
+	char *text;
+	sd_bus_message *copy;
+
+	while (read(*fd, &copy, sizeof copy) == sizeof copy && copy != NULL) {
+		text = text_of(copy);
+		check(text != NULL && !strcmp(text, expected), "executor", text ?: "not converted");
+		free(text);
+		sd_bus_message_unref(copy);
+	}
+	return NULL;
+}
+
+/* the DBUS thread copies each signal for the executor and converts the signal */
+static void check_threads(void)
+{
+	int i, rc, pipefds[2];
+	char *text;
+	pthread_t thread;
+	sd_bus_message *msg, *copy;
+
+	if (pipe(pipefds) < 0 || pthread_create(&thread, NULL, executor, &pipefds[0]) != 0) {
+		check(0, "executor", "not started");
+		return;
+	}
+	for (i = 1 ; i <= COUNT ; i++) {
+		msg = new_signal((uint64_t)i);
+		if (msg == NULL)
+			break;
+		rc = dbus_copy_signal(msg, &copy);
+		check(rc >= 0, "copy", "failed");
+		if (rc >= 0) {
+			if (i == 1)
+				check_fields(msg, copy);
+			if (write(pipefds[1], &copy, sizeof copy) != sizeof copy)
+				check(0, "executor", "not reached");
+		}
+		text = text_of(msg);
+		check(text != NULL && !strcmp(text, expected), "watch", text ?: "not converted");
+		free(text);
+		sd_bus_message_unref(msg);
+	}
+	copy = NULL;
+	if (write(pipefds[1], &copy, sizeof copy) != sizeof copy)
+		check(0, "executor", "not stopped");
+	pthread_join(thread, NULL);
+	close(pipefds[0]);
+	close(pipefds[1]);
+}
+
+int main(void)
+{
+	sd_id128_t id = {};
+	int fds[2];
+	sd_bus_message *msg;
+
+	/* messages need a started bus, a private socket is enough */
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0
+	 || sd_bus_new(&bus) < 0
+	 || sd_bus_set_fd(bus, fds[0], fds[0]) < 0
+	 || sd_bus_set_server(bus, 1, id) < 0
+	 || sd_bus_set_anonymous(bus, 1) < 0
+	 || sd_bus_start(bus) < 0) {
+		fprintf(stderr, "can't create the bus\n");
+		return 1;
+	}
+
+	/* the conversion read from a signal that no other thread reads */
+	msg = new_signal(1);
+	expected = msg == NULL ? NULL : text_of(msg);
+	sd_bus_message_unref(msg);
+	if (expected == NULL) {
+		fprintf(stderr, "can't convert the signal\n");
+		return 1;
+	}
+
+	check_threads();
+
+	free(expected);
+	sd_bus_close(bus);
+	sd_bus_unref(bus);
+	close(fds[1]);
+	if (failures != 0)
+		return 1;
+	puts("ok");
+	return 0;
+}
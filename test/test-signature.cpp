@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2015-2020 "IoT.bzh"
+ * Author José Bollo <jose.bollo@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compiles the signatures of dbus-signature.hpp and checks that
+ * the values packed in a message are unpacked unchanged.
+ */
+
+#include <cstdio>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "dbus-signature.hpp"
+
+static int failures = 0;
+
+/* report the failure of the check */
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAILED %s\n", what);
+		failures++;
+	}
+}
+
+/* a new signal message of the bus */
+static sd_bus_message *new_message(sd_bus *bus)
+{
+	sd_bus_message *msg = nullptr;
+	int rc = sd_bus_message_new_signal(bus, &msg, "/test", "bzh.iot.test", "Test");
+	check(rc >= 0, "new message");
+	return msg;
+}
+
+/* pack the values with S, seal the message, unpack and compare */
+template<dbus::fixed_string S>
+static void roundtrip(sd_bus *bus, const typename dbus::sig<S>::type &values)
+{
+	typename dbus::sig<S>::type result;
+	sd_bus_message *msg = new_message(bus);
+
+	if (msg == nullptr)
+		return;
+	check(dbus::sig<S>::pack_tuple(msg, values) >= 0, S.data);
+	check(sd_bus_message_seal(msg, 1, 0) >= 0, S.data);
+	check(sd_bus_message_rewind(msg, 1) >= 0, S.data);
+	check(dbus::sig<S>::unpack(msg, result) >= 0, S.data);
+	check(result == values, S.data);
+	check(sd_bus_message_at_end(msg, 1) > 0, S.data);
+	sd_bus_message_unref(msg);
+}
+
+/* variants of containers are not supported */
+static void unsupported(sd_bus *bus)
+{
+	dbus::sig<"a{sv}">::type result;
+	sd_bus_message *msg = new_message(bus);
+
+	if (msg == nullptr)
+		return;
+	check(sd_bus_message_append(msg, "a{sv}", 2, "Name", "s", "out", "List", "as", 2, "a", "b") >= 0, "a{sv} of as");
+	check(sd_bus_message_seal(msg, 1, 0) >= 0, "a{sv} of as");
+	check(sd_bus_message_rewind(msg, 1) >= 0, "a{sv} of as");
+	check(dbus::sig<"a{sv}">::unpack(msg, result) == -ENOTSUP, "a{sv} of as");
+	sd_bus_message_unref(msg);
+}
+
+int main()
+{
+	sd_bus *bus = nullptr;
+	sd_id128_t id{};
+	int fds[2];
+
+	/* messages need a started bus, a private socket is enough */
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0
+	 || sd_bus_new(&bus) < 0
+	 || sd_bus_set_fd(bus, fds[0], fds[0]) < 0
+	 || sd_bus_set_server(bus, 1, id) < 0
+	 || sd_bus_set_anonymous(bus, 1) < 0
+	 || sd_bus_start(bus) < 0) {
+		std::fprintf(stderr, "can't create the bus\n");
+		return 1;
+	}
+
+	roundtrip<"y">(bus, { 200 });
+	roundtrip<"bnq">(bus, { true, -3, 65000 });
+	roundtrip<"iuxtd">(bus, { -1, 4000000000u, -5, 6, 0.1 });
+	roundtrip<"sog">(bus, { "text", { "/a/b" }, { "a{sv}" } });
+	roundtrip<"ab">(bus, { { true, false, true } });
+	roundtrip<"(sab)">(bus, { { "flags", { false, true } } });
+	roundtrip<"ai">(bus, { { 1, 2, 3 } });
+	roundtrip<"ad">(bus, { { 0.5, -1.5 } });
+	roundtrip<"as">(bus, { { "x", "", "z" } });
+	roundtrip<"aas">(bus, { { { "a" }, {}, { "b", "c" } } });
+	roundtrip<"a{sv}">(bus, { { { "Volume", 0.5 }, { "Muted", true }, { "Name", std::string("out") } } });
+	roundtrip<"a{ua(sb)}">(bus, { { { 1, { { "x", true } } }, { 2, {} } } });
+	roundtrip<"(i(sd))">(bus, { { 7, { "pi", 3.14 } } });
+	unsupported(bus);
+
+	sd_bus_close(bus);
+	sd_bus_unref(bus);
+	close(fds[1]);
+	if (failures != 0)
+		return 1;
+	std::puts("ok");
+	return 0;
+}